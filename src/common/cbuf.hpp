@@ -6,6 +6,12 @@
 #include <cstddef>
 #include <cstring>
 
+/*
+ * Lock-free ring for a single producer and a single consumer. The
+ * indices only ever grow and are masked on access; each side keeps its
+ * own index and a cached copy of the other's on a separate cache line,
+ * so the shared indices are only reloaded when the cached view runs out.
+ */
 template <typename T, std::size_t Capacity>
 class Cbuf {
     static_assert(Capacity != 0, "Capacity cannot be zero");
@@ -14,40 +20,71 @@ class Cbuf {
 public:
     std::size_t Enqueue(const T *data, std::size_t count)
     {
-        count = std::min(count, Availible());
+        const std::size_t write = m_write.load(std::memory_order_relaxed);
 
-        const std::size_t length1 = std::min(Capacity - m_write, count);
-        std::memcpy(&m_buffer[m_write], data, length1);
+        if (Capacity - (write - m_read_cache) < count) {
+            m_read_cache = m_read.load(std::memory_order_acquire);
+        }
+
+        count = std::min(count, Capacity - (write - m_read_cache));
+
+        const std::size_t index = write & Mask;
+
+        const std::size_t length1 = std::min(Capacity - index, count);
+        std::memcpy(&m_buffer[index], data, length1 * sizeof(T));
 
         const std::size_t length2 = count - length1;
-        std::memcpy(m_buffer.data(), &data[length1], length2);
+        std::memcpy(m_buffer.data(), &data[length1], length2 * sizeof(T));
 
-        m_write = (m_write + count) % Capacity;
+        m_write.store(write + count, std::memory_order_release);
         return count;
     }
 
     std::size_t Dequeue(T *data, std::size_t count)
     {
-        count = std::min(count, Size());
+        const std::size_t read = m_read.load(std::memory_order_relaxed);
+
+        if (m_write_cache - read < count) {
+            m_write_cache = m_write.load(std::memory_order_acquire);
+        }
+
+        count = std::min(count, m_write_cache - read);
+
+        const std::size_t index = read & Mask;
 
-        const std::size_t length1 = std::min(Capacity - m_read, count);
-        std::memcpy(data, &m_buffer[m_read], length1);
+        const std::size_t length1 = std::min(Capacity - index, count);
+        std::memcpy(data, &m_buffer[index], length1 * sizeof(T));
 
         const std::size_t length2 = count - length1;
-        std::memcpy(&data[length1], m_buffer.data(), length2);
+        std::memcpy(&data[length1], m_buffer.data(), length2 * sizeof(T));
 
-        m_read = (m_read + count) % Capacity;
+        m_read.store(read + count, std::memory_order_release);
         return count;
     }
 
-    inline bool Empty() const { return m_read == m_write; }
-    inline bool Full() const { return Size() == Capacity - 1; }
+    /* approximate from the side that does not own both indices */
+    inline std::size_t Size() const
+    {
+        const std::size_t read = m_read.load(std::memory_order_acquire);
+        return m_write.load(std::memory_order_acquire) - read;
+    }
+
+    inline bool Empty() const { return Size() == 0; }
+    inline bool Full() const { return Size() == Capacity; }
 
-    inline std::size_t Size() const { return (m_write - m_read) % Capacity; }
-    inline std::size_t Availible() const { return Capacity - Size() - 1; }
+    inline std::size_t Availible() const { return Capacity - Size(); }
 
 private:
-    std::array<T, Capacity> m_buffer;
-    std::atomic<std::size_t> m_read = 0;
-    std::atomic<std::size_t> m_write = 0;
+    static constexpr std::size_t Mask = Capacity - 1;
+    static constexpr std::size_t CacheLine = 64;
+
+    /* written by the producer */
+    alignas(CacheLine) std::atomic<std::size_t> m_write = 0;
+    std::size_t m_read_cache = 0;
+
+    /* written by the consumer */
+    alignas(CacheLine) std::atomic<std::size_t> m_read = 0;
+    std::size_t m_write_cache = 0;
+
+    alignas(CacheLine) std::array<T, Capacity> m_buffer;
 };
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+
+#include "types.hpp"
+
+/*
+ * One bit per 4 KiB page of a memory, set by whatever writes to it and
+ * cleared by whoever last took a copy. Marking is a shift and an or,
+ * cheap enough to sit on the cpu's store path.
+ */
+template <std::size_t Size>
+class DirtyPages {
+public:
+    static constexpr std::size_t PageShift = 12;
+    static constexpr std::size_t PageSize = std::size_t(1) << PageShift;
+    static constexpr std::size_t Count = Size >> PageShift;
+
+    static_assert(Size % PageSize == 0, "Size must be a whole number of pages");
+
+    inline void Mark(std::size_t offset)
+    {
+        const std::size_t page = offset >> PageShift;
+        m_bits[page / 64] |= u64(1) << (page % 64);
+    }
+
+    /* offset and size are in bytes; a range running off the end stops there */
+    inline void Mark(std::size_t offset, std::size_t size)
+    {
+        if (size == 0) {
+            return;
+        }
+
+        const std::size_t last = std::min((offset + size - 1) >> PageShift, Count - 1);
+
+        for (std::size_t page = offset >> PageShift; page <= last; ++page) {
+            m_bits[page / 64] |= u64(1) << (page % 64);
+        }
+    }
+
+    inline void MarkAll() { m_bits.fill(~u64(0)); }
+    inline void Clear() { m_bits.fill(0); }
+
+    inline bool Test(std::size_t page) const
+    {
+        return (m_bits[page / 64] >> (page % 64)) & 1;
+    }
+
+private:
+    std::array<u64, (Count + 63) / 64> m_bits = {};
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+
+#include "types.hpp"
+
+/*
+ * Pulls interleaved stereo frames out of a ring at a rate nudged by its
+ * fill level: a ring filling past the target is drained slightly faster
+ * than real time and one running dry slightly slower, so small clock
+ * drift between producer and device is absorbed without audible gaps.
+ */
+template <typename Ring>
+class Resampler {
+public:
+    Resampler(Ring& ring, std::size_t target_frames, double max_deviation = 0.005)
+        : m_ring(ring), m_target(static_cast<double>(target_frames)),
+          m_max_deviation(max_deviation), m_fill(m_target) {}
+
+    void Resample(s16 *output, std::size_t frames)
+    {
+        /* smooth the fill level so bursts from the producer do not warble */
+        const double fill = static_cast<double>(m_ring.Size() / 2);
+        m_fill += (fill - m_fill) / 16.0;
+
+        const double error = std::clamp((m_fill - m_target) / m_target, -1.0, 1.0);
+        const double step = 1.0 + m_max_deviation * error;
+
+        for (std::size_t i = 0; i < frames; ++i) {
+            while (m_position >= 1.0) {
+                m_previous[0] = m_next[0];
+                m_previous[1] = m_next[1];
+
+                /* on underrun the last frame is held rather than dropping to silence */
+                s16 frame[2];
+
+                if (m_ring.Dequeue(frame, 2) == 2) {
+                    m_next[0] = frame[0];
+                    m_next[1] = frame[1];
+                }
+
+                m_position -= 1.0;
+            }
+
+            for (std::size_t c = 0; c < 2; ++c) {
+                output[2 * i + c] = static_cast<s16>(m_previous[c] + (m_next[c] - m_previous[c]) * m_position);
+            }
+
+            m_position += step;
+        }
+    }
+
+private:
+    Ring& m_ring;
+
+    const double m_target;
+    const double m_max_deviation;
+
+    double m_fill;
+    double m_position = 0.0;
+
+    s16 m_previous[2] = {};
+    s16 m_next[2] = {};
+};
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "error.hpp"
+#include "types.hpp"
+
+/*
+ * Walks a component's state in either direction: the same DoState
+ * function appends it to a buffer when saving and reads it back when
+ * loading, so the two sides cannot disagree on layout.
+ */
+class Serializer {
+public:
+    /* saving, appending to buffer */
+    explicit Serializer(std::vector<u8>& buffer)
+        : m_buffer(&buffer), m_data(nullptr), m_size(0), m_position(0) {}
+
+    /* loading, reading from data */
+    Serializer(const u8 *data, std::size_t size)
+        : m_buffer(nullptr), m_data(data), m_size(size), m_position(0) {}
+
+    inline bool Loading() const { return m_buffer == nullptr; }
+
+    template <typename T>
+    inline void Do(T& value)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+        DoBytes(&value, sizeof(T));
+    }
+
+    template <typename T>
+    void Do(std::vector<T>& values)
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "T must be trivially copyable");
+
+        u32 count = static_cast<u32>(values.size());
+        Do(count);
+
+        if (Loading()) {
+            values.resize(count);
+        }
+
+        DoBytes(values.data(), sizeof(T) * count);
+    }
+
+    void DoBytes(void *data, std::size_t size)
+    {
+        if (!Loading()) {
+            const u8 *bytes = static_cast<const u8 *>(data);
+            m_buffer->insert(m_buffer->end(), bytes, bytes + size);
+            return;
+        }
+
+        if (size > m_size - m_position) {
+            Common::Error::Fatal("state ends early");
+        }
+
+        std::memcpy(data, m_data + m_position, size);
+        m_position += size;
+    }
+
+    /* opens a section, so a stream that has drifted is caught where it happens */
+    void Section(const char (&name)[5])
+    {
+        const u32 tag = u32(u8(name[0])) | u32(u8(name[1])) << 8 | u32(u8(name[2])) << 16 | u32(u8(name[3])) << 24;
+
+        u32 value = tag;
+        Do(value);
+
+        if (value != tag) {
+            Common::Error::Fatal("state section out of place");
+        }
+    }
+
+private:
+    std::vector<u8> *m_buffer;
+
+    const u8 *m_data;
+    std::size_t m_size, m_position;
+};
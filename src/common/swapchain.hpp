@@ -1,33 +1,46 @@
 #pragma once
 
+#include <array>
+#include <atomic>
 #include <cstddef>
-#include <functional>
-#include <mutex>
 
 #include "types.hpp"
 
+/* Lock-free triple buffer for a single producer and a single consumer */
 template <std::size_t Size, typename T>
 class Swapchain {
-    static_assert(Size == 2, "swapchain currently only supports two buffers");
+    static_assert(Size == 3, "swapchain currently only supports three buffers");
 
 public:
-    inline void WithConsumer(std::function<void(T&)> f)
+    inline T& ProducerBuffer() { return m_buffers[m_producer]; }
+
+    inline void Swap()
     {
-        std::lock_guard guard(m_mutex);
-        f(m_buffers[!m_index]);
+        const u8 ready = m_ready.exchange(m_producer | FreshBit, std::memory_order_acq_rel);
+        m_producer = ready & IndexMask;
     }
 
-    inline T& ProducerBuffer() { return m_buffers[m_index]; }
-
-    inline void Swap()
+    /* Returns true if a new buffer has been made current since the last call */
+    inline bool Acquire()
     {
-        std::lock_guard guard(m_mutex);
-        m_index = !m_index;
+        if ((m_ready.load(std::memory_order_relaxed) & FreshBit) == 0) {
+            return false;
+        }
+
+        const u8 ready = m_ready.exchange(m_consumer, std::memory_order_acq_rel);
+        m_consumer = ready & IndexMask;
+        return true;
     }
 
+    inline const T& ConsumerBuffer() const { return m_buffers[m_consumer]; }
+
 private:
-    bool m_index = 0;
+    static constexpr u8 IndexMask = 0x3;
+    static constexpr u8 FreshBit = 0x4;
+
+    u8 m_producer = 0;
+    u8 m_consumer = 1;
+    std::atomic<u8> m_ready = 2;
 
-    std::mutex m_mutex;
-    std::array<T, 2> m_buffers;
+    std::array<T, Size> m_buffers;
 };
@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <filesystem>
 
@@ -11,22 +13,46 @@
 #include "error.hpp"
 #include "intc.hpp"
 #include "scheduler.hpp"
+#include "spu.hpp"
 
 #include "disc/bin.hpp"
+#include "disc/compressed_bin.hpp"
+#include "disc/cue.hpp"
+#include "disc/mapped_bin.hpp"
+#include "disc/read_ahead.hpp"
 
 namespace Core
 {
 
-Cdc::Cdc(Emulator *emulator, const std::filesystem::path& disc)
+Cdc::Cdc(Emulator *emulator, const std::filesystem::path& disc, DiscAccess access)
     : m_emulator(emulator)
 {
-    Reset();
+    /* an empty path leaves the drive empty, for running a bare exe */
+    if (disc.empty()) {
+        m_disc = nullptr;
+    } else if (disc.extension() == ".bin") {
+#if defined(BTPSX_HAVE_MMAP)
+        if (access == DiscAccess::Mapped) {
+            m_disc = std::make_unique<MappedBin>(disc);
+        } else {
+            m_disc = std::make_unique<ReadAhead>(std::make_unique<Bin>(disc));
+        }
+#else
+        if (access == DiscAccess::Mapped) {
+            spdlog::warn("mapped disc access is unavailable, reading ahead instead");
+        }
 
-    if (disc.extension() == ".bin") {
-        m_disc = std::make_unique<Bin>(disc);
+        m_disc = std::make_unique<ReadAhead>(std::make_unique<Bin>(disc));
+#endif
+    } else if (disc.extension() == ".cue") {
+        m_disc = std::make_unique<ReadAhead>(std::make_unique<Cue>(disc));
+    } else if (disc.extension() == ".cbin") {
+        m_disc = std::make_unique<ReadAhead>(std::make_unique<CompressedBin>(disc));
     } else {
         Error("unsupported disc format {}", disc.extension().string());
     }
+
+    Reset();
 }
 
 void Cdc::Reset()
@@ -43,26 +69,83 @@ void Cdc::Reset()
 
     m_stat.raw = m_mode.raw = 0;
 
+    /* an empty drive looks like one with its lid up, which keeps the bios in its shell */
+    m_stat.shell_open = !m_disc;
+
     m_command2 = Command::Sync;
 
     m_parameter_fifo_size = m_response_fifo_size = m_data_fifo_size = 0;
+    m_data_fifo_position = 0;
+
+    m_sector = m_sector_buffer.data();
+    m_data = m_data_fifo.data();
 
     m_interrupt_enables = m_interrupt_flags = 0;
+
+    m_filter_file = m_filter_channel = 0;
+
+    m_volume = m_pending_volume = { 0x80, 0x00, 0x80, 0x00 };
+    m_muted = m_adpcm_muted = false;
+
+    m_xa_adpcm.Reset();
 }
 
-void Cdc::Tick()
+void Cdc::DoState(Serializer& s)
 {
-    if (m_status.busysts && --m_command_counter == 0) {
-        ExecuteCommand();
-    }
+    s.Section("CDC ");
 
-    if (m_command2 != Command::Sync && --m_command2_counter == 0) {
-        ExecuteCommandSecondResponse();
-    }
+    s.Do(m_status);
+    s.Do(m_stat);
+    s.Do(m_mode);
 
-    if (m_stat.drive_state == DriveState::Reading && --m_sector_counter == 0) {
-        DeliverDataSector();
+    s.Do(m_setloc_timecode);
+    s.Do(m_drive_timecode);
+    s.Do(m_setloc_unprocessed);
+
+    s.Do(m_command);
+    s.Do(m_command2);
+
+    s.Do(m_parameter_fifo_size);
+    s.Do(m_parameter_fifo);
+    s.Do(m_response_fifo_size);
+    s.Do(m_response_fifo);
+
+    /* the sector and data fifo may be views into the disc, so their contents are kept instead */
+    if (!s.Loading()) {
+        if (m_sector != m_sector_buffer.data()) {
+            std::memcpy(m_sector_buffer.data(), m_sector, DiscSectorSize);
+        }
+
+        if (m_data != m_data_fifo.data()) {
+            std::memcpy(m_data_fifo.data(), m_data, m_data_fifo_size);
+        }
     }
+
+    s.Do(m_sector_buffer);
+    s.Do(m_data_fifo_size);
+    s.Do(m_data_fifo_position);
+    s.Do(m_data_fifo);
+
+    m_sector = m_sector_buffer.data();
+    m_data = m_data_fifo.data();
+
+    s.Do(m_interrupt_enables);
+    s.Do(m_interrupt_flags);
+    s.Do(m_filter_file);
+    s.Do(m_filter_channel);
+
+    s.Do(m_volume);
+    s.Do(m_pending_volume);
+    s.Do(m_muted);
+    s.Do(m_adpcm_muted);
+
+    m_xa_adpcm.DoState(s);
+
+    Scheduler *scheduler = m_emulator->m_scheduler.get();
+
+    scheduler->DoEvent(s, Scheduler::Event::Type::CdCommand, [=]() { ExecuteCommand(); });
+    scheduler->DoEvent(s, Scheduler::Event::Type::CdCommand2, [=]() { ExecuteCommandSecondResponse(); });
+    scheduler->DoEvent(s, Scheduler::Event::Type::CdSector, [=]() { DeliverSector(); });
 }
 
 uint8_t Cdc::Read(uint32_t addr)
@@ -133,7 +216,7 @@ void Cdc::Write(uint32_t addr, uint8_t data)
         m_status.busysts = true;
         break;
     case 3:
-        spdlog::warn("unimplemented cdc volume");
+        m_pending_volume.r_to_r = data;
         break;
     case 4:
         if (m_parameter_fifo_size >= ParameterFifoSize) {
@@ -148,8 +231,10 @@ void Cdc::Write(uint32_t addr, uint8_t data)
         m_interrupt_enables = data & 0x1f;
         break;
     case 6:
+        m_pending_volume.l_to_l = data;
+        break;
     case 7:
-        spdlog::warn("unimplemented cdc volume");
+        m_pending_volume.r_to_l = data;
         break;
     case 8:
         if (Bit::Check<5>(data)) {
@@ -176,10 +261,15 @@ void Cdc::Write(uint32_t addr, uint8_t data)
 
         break;
     case 10:
-        spdlog::warn("unimplemented cdc volume");
+        m_pending_volume.l_to_r = data;
         break;
     case 11:
-        spdlog::warn("unimplemented cdc apply volume");
+        m_adpcm_muted = Bit::Check<0>(data);
+
+        if (Bit::Check<5>(data)) {
+            m_volume = m_pending_volume;
+        }
+
         break;
     default: Error("write to unknown CDC reg 0x{:08x} index {}",
                                 addr, m_status.index);
@@ -188,20 +278,24 @@ void Cdc::Write(uint32_t addr, uint8_t data)
 
 uint32_t Cdc::ReadDma()
 {
-    if (m_data_fifo_size < 4) {
-        Error("cdc data fifo underflow");
-    }
+    uint32_t data;
+    ReadDmaBlock(&data, 1);
+
+    return data;
+}
 
-    const uint32_t data = *reinterpret_cast<uint32_t *>(m_data_fifo.data());
+void Cdc::ReadDmaBlock(uint32_t *data, size_t words)
+{
+    const size_t length = 4 * words;
 
-    for (size_t i = 4; i < m_data_fifo_size; ++i) {
-        m_data_fifo[i - 4] = m_data_fifo[i];
+    if (m_data_fifo_size - m_data_fifo_position < length) {
+        Error("cdc data fifo underflow");
     }
 
-    m_data_fifo_size -= 4;
-    m_status.drqsts = m_data_fifo_size > 0;
+    std::memcpy(data, &m_data[m_data_fifo_position], length);
 
-    return data;
+    m_data_fifo_position += length;
+    m_status.drqsts = m_data_fifo_position < m_data_fifo_size;
 }
 
 /* TODO: move this */
@@ -210,11 +304,20 @@ static inline uint8_t BcdToDecimal(uint8_t x)
     return x - 6 * (x >> 4);
 }
 
+static inline uint8_t DecimalToBcd(uint8_t x)
+{
+    return x + 6 * (x / 10);
+}
+
+/* the drive rejects a command when its parameters are out of range */
+static constexpr uint8_t InvalidParameter = 0x10;
+
 void Cdc::ExecuteCommand()
 {
-    spdlog::debug("cdc command 0x{:02x}", m_command);
+    spdlog::debug("cdc command 0x{:02x}", static_cast<uint8_t>(m_command));
 
     size_t counter;
+    uint8_t interrupt = 0x3;
 
     switch(m_command) {
     case Command::GetStat:
@@ -230,42 +333,41 @@ void Cdc::ExecuteCommand()
 
         m_setloc_unprocessed = true;
 
+        /* start fetching while the game gets round to seeking */
+        if (m_disc) {
+            m_disc->Prefetch(TimecodeToSector(m_setloc_timecode));
+        }
+
         m_response_fifo[0] = m_stat.raw;
 
         m_response_fifo_size = 1;
         m_status.rslrrdy = true;
         break;
-    case Command::ReadN:
-        m_stat.drive_state = DriveState::Reading;
-
-        counter = 33868800 / 75;
+    case Command::Play:
+        /* a track number plays from its start, otherwise from the setloc position */
+        if (m_parameter_fifo_size != 0 && m_parameter_fifo[0] != 0) {
+            const size_t track = BcdToDecimal(m_parameter_fifo[0]);
+
+            if (!m_disc || track > m_disc->TrackCount()) {
+                interrupt = ErrorResponse(InvalidParameter);
+                break;
+            }
 
-        if (m_mode.drive_speed == DriveSpeed::Double) {
-            counter /= 2;
+            m_setloc_timecode = SectorToTimecode(m_disc->TrackStart(track));
+            m_setloc_unprocessed = true;
         }
 
-        m_emulator->m_scheduler->AddEvent(
-            Scheduler::Event::Type::CdSector,
-            Scheduler::Event::Mode::Manual,
-            counter,
-            [=]() {
-                DeliverDataSector();
-
-                std::size_t c = 33868800 / 75;
+        StartReading(DriveState::Playing);
 
-                if (m_mode.drive_speed == DriveSpeed::Double) {
-                    c /= 2;
-                }
-
-                m_emulator->m_scheduler->RescheduleEvent(Scheduler::Event::Type::CdSector, c);
-
-            }
-        );
+        m_response_fifo[0] = m_stat.raw;
 
-        if (m_setloc_unprocessed) {
-            m_drive_timecode = m_setloc_timecode;
-            m_setloc_unprocessed = false;
-        }
+        m_response_fifo_size = 1;
+        m_status.rslrrdy = true;
+        break;
+    /* reads are never retried here, so streaming reads behave just like normal ones */
+    case Command::ReadN:
+    case Command::ReadS:
+        StartReading(DriveState::Reading);
 
         m_response_fifo[0] = m_stat.raw;
 
@@ -285,21 +387,13 @@ void Cdc::ExecuteCommand()
             counter /= 2;
         }
 
+        /* pausing an idle drive only has to acknowledge */
         if (m_stat.drive_state == DriveState::None) {
             counter = 7500;
-            break;
         }
 
-        m_emulator->m_scheduler->AddEvent(
-            Scheduler::Event::Type::CdCommand2,
-            Scheduler::Event::Mode::Once,
-            counter,
-            [=]() { ExecuteCommandSecondResponse(); }
-        );
-
-        if (m_stat.drive_state == DriveState::Reading) {
-            m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdSector);
-        }
+        ScheduleSecondResponse(counter);
+        StopReading();
 
         m_stat.drive_state = DriveState::None;
         break;
@@ -311,18 +405,11 @@ void Cdc::ExecuteCommand()
 
         m_command2 = m_command;
 
-        m_emulator->m_scheduler->AddEvent(
-            Scheduler::Event::Type::CdCommand2,
-            Scheduler::Event::Mode::Once,
-            20000,
-            [=]() { ExecuteCommandSecondResponse(); }
-        );
+        ScheduleSecondResponse(20000);
 
         m_stat.motor_on = true;
-        
-        if (m_stat.drive_state == DriveState::Reading) {
-            m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdSector);
-        }
+
+        StopReading();
 
         m_stat.drive_state = DriveState::None;
 
@@ -330,7 +417,26 @@ void Cdc::ExecuteCommand()
 
         m_mode.raw = 0;
         break;
+    case Command::Mute:
+        m_muted = true;
+
+        m_response_fifo[0] = m_stat.raw;
+
+        m_response_fifo_size = 1;
+        m_status.rslrrdy = true;
+        break;
     case Command::Demute:
+        m_muted = false;
+
+        m_response_fifo[0] = m_stat.raw;
+
+        m_response_fifo_size = 1;
+        m_status.rslrrdy = true;
+        break;
+    case Command::SetFilter:
+        m_filter_file = m_parameter_fifo[0];
+        m_filter_channel = m_parameter_fifo[1];
+
         m_response_fifo[0] = m_stat.raw;
 
         m_response_fifo_size = 1;
@@ -345,19 +451,44 @@ void Cdc::ExecuteCommand()
         m_status.rslrrdy = true;
         break;
     case Command::GetTn:
+        if (!m_disc) {
+            interrupt = ErrorResponse(InvalidParameter);
+            break;
+        }
+
         m_response_fifo[0] = m_stat.raw;
         m_response_fifo[1] = 0x01;
-        m_response_fifo[2] = 0x02;
+        m_response_fifo[2] = DecimalToBcd(m_disc->TrackCount());
 
         m_response_fifo_size = 3;
         m_status.rslrrdy = true;
         break;
+    case Command::GetTd: {
+        const size_t track = BcdToDecimal(m_parameter_fifo[0]);
+
+        if (!m_disc || m_parameter_fifo_size == 0 || track > m_disc->TrackCount()) {
+            interrupt = ErrorResponse(InvalidParameter);
+            break;
+        }
+
+        /* track 0 is the lead-out, just past the last sector */
+        const size_t sector = (track == 0) ? LeadInSectors + m_disc->SectorCount()
+                                           : m_disc->TrackStart(track);
+
+        const Timecode timecode = SectorToTimecode(sector);
+
+        m_response_fifo[0] = m_stat.raw;
+        m_response_fifo[1] = DecimalToBcd(timecode.minute);
+        m_response_fifo[2] = DecimalToBcd(timecode.second);
+
+        m_response_fifo_size = 3;
+        m_status.rslrrdy = true;
+        break;
+    }
     case Command::SeekL:
         m_stat.motor_on = true;
-        
-        if (m_stat.drive_state == DriveState::Reading) {
-            m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdSector);
-        }
+
+        StopReading();
 
         m_stat.drive_state = DriveState::Seeking;
 
@@ -368,13 +499,7 @@ void Cdc::ExecuteCommand()
 
         m_command2 = m_command;
 
-        m_emulator->m_scheduler->AddEvent(
-            Scheduler::Event::Type::CdCommand2,
-            Scheduler::Event::Mode::Once,
-            20000,
-            [=]() { ExecuteCommandSecondResponse(); }
-        );
-
+        ScheduleSecondResponse(20000 + SeekPeriod(m_drive_timecode, m_setloc_timecode));
         break;
     case Command::Test:
         ExecuteTestCommand();
@@ -387,18 +512,12 @@ void Cdc::ExecuteCommand()
 
         m_command2 = m_command;
 
-        m_emulator->m_scheduler->AddEvent(
-            Scheduler::Event::Type::CdCommand2,
-            Scheduler::Event::Mode::Once,
-            20000,
-            [=]() { ExecuteCommandSecondResponse(); }
-        );
-
+        ScheduleSecondResponse(20000);
         break;
-    default: Error("unknown cdc command 0x{:02x}", m_command);
+    default: Error("unknown cdc command 0x{:02x}", static_cast<uint8_t>(m_command));
     }
 
-    m_interrupt_flags = 0x3;
+    m_interrupt_flags = interrupt;
 
     /* TODO: edge-triggered interrupt */
     if ((m_interrupt_flags & m_interrupt_enables & 0x1f) != 0) {
@@ -427,9 +546,7 @@ void Cdc::ExecuteCommandSecondResponse()
     case Command::SeekL:
         m_drive_timecode = m_setloc_timecode;
 
-        if (m_stat.drive_state == DriveState::Reading) {
-            m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdSector);
-        }
+        StopReading();
 
         m_stat.drive_state = DriveState::None;
 
@@ -443,6 +560,23 @@ void Cdc::ExecuteCommandSecondResponse()
         m_interrupt_flags = 0x2;
         break;
     case Command::GetId:
+        if (!m_disc) {
+            m_response_fifo[0] = 0x08;
+            m_response_fifo[1] = 0x40;
+            m_response_fifo[2] = 0x00;
+            m_response_fifo[3] = 0x00;
+            m_response_fifo[4] = 0x00;
+            m_response_fifo[5] = 0x00;
+            m_response_fifo[6] = 0x00;
+            m_response_fifo[7] = 0x00;
+
+            m_response_fifo_size = 8;
+            m_status.rslrrdy = true;
+
+            m_interrupt_flags = 0x5;
+            break;
+        }
+
         m_response_fifo[0] = 0x02;
         m_response_fifo[1] = 0x00;
         m_response_fifo[2] = 0x20;
@@ -451,22 +585,13 @@ void Cdc::ExecuteCommandSecondResponse()
         m_response_fifo[5] = 0x43;
         m_response_fifo[6] = 0x45;
         m_response_fifo[7] = 0x41;
-        //m_response_fifo[0] = 0x08;
-        //m_response_fifo[1] = 0x40;
-        //m_response_fifo[2] = 0x00;
-        //m_response_fifo[3] = 0x00;
-        //m_response_fifo[4] = 0x00;
-        //m_response_fifo[5] = 0x00;
-        //m_response_fifo[6] = 0x00;
-        //m_response_fifo[7] = 0x00;
 
         m_response_fifo_size = 8;
         m_status.rslrrdy = true;
 
         m_interrupt_flags = 0x2;
-        //m_interrupt_flags = 0x5;
         break;
-    default: Error("unknown cdc command 0x{:02x}", m_command2);
+    default: Error("unknown cdc command 0x{:02x}", static_cast<uint8_t>(m_command2));
     }
 
     m_command2 = Command::Sync;
@@ -500,22 +625,122 @@ void Cdc::ExecuteTestCommand()
     }
 }
 
-void Cdc::DeliverDataSector()
+size_t Cdc::TimecodeToSector(const Timecode& timecode)
+{
+    return 75 * (60 * timecode.minute + timecode.second) + timecode.sector;
+}
+
+Cdc::Timecode Cdc::SectorToTimecode(size_t sector)
+{
+    Timecode timecode;
+
+    timecode.minute = sector / (60 * 75);
+    timecode.second = (sector / 75) % 60;
+    timecode.sector = sector % 75;
+
+    return timecode;
+}
+
+uint8_t Cdc::ErrorResponse(uint8_t reason)
+{
+    m_response_fifo[0] = m_stat.raw | 0x1;
+    m_response_fifo[1] = reason;
+
+    m_response_fifo_size = 2;
+    m_status.rslrrdy = true;
+
+    return 0x5;
+}
+
+int64_t Cdc::SectorPeriod() const
+{
+    const int64_t period = static_cast<int64_t>(Emulator::CpuFrequency / 75);
+    return (m_mode.drive_speed == DriveSpeed::Double) ? period / 2 : period;
+}
+
+int64_t Cdc::SeekPeriod(const Timecode& from, const Timecode& to) const
+{
+    const int64_t start = static_cast<int64_t>(TimecodeToSector(from));
+    const int64_t end = static_cast<int64_t>(TimecodeToSector(to));
+
+    /* a sweep across the whole disc takes roughly half a second */
+    const int64_t distance = std::abs(end - start);
+    return distance * static_cast<int64_t>(Emulator::CpuFrequency / 2) / DiscSectors;
+}
+
+void Cdc::ScheduleSecondResponse(int64_t ticks)
+{
+    if (m_emulator->m_scheduler->EventActive(Scheduler::Event::Type::CdCommand2)) {
+        m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdCommand2);
+    }
+
+    m_emulator->m_scheduler->AddEvent(
+        Scheduler::Event::Type::CdCommand2,
+        Scheduler::Event::Mode::Once,
+        ticks,
+        [=]() { ExecuteCommandSecondResponse(); }
+    );
+}
+
+void Cdc::StartReading(DriveState state)
 {
-    const uint8_t mm = m_drive_timecode.minute;
-    const uint8_t ss = m_drive_timecode.second;
-    const uint8_t ff = m_drive_timecode.sector;
+    StopReading();
+
+    m_stat.drive_state = state;
 
-    const size_t sector = 75 * (60 * mm + ss) + ff;
+    int64_t counter = SectorPeriod();
 
-    if (sector >= 80 * 60 * 75) {
+    /* an unprocessed setloc means the head has to move first */
+    if (m_setloc_unprocessed) {
+        counter += SeekPeriod(m_drive_timecode, m_setloc_timecode);
+
+        m_drive_timecode = m_setloc_timecode;
+        m_setloc_unprocessed = false;
+    }
+
+    m_xa_adpcm.Reset();
+
+    m_emulator->m_scheduler->AddEvent(
+        Scheduler::Event::Type::CdSector,
+        Scheduler::Event::Mode::Manual,
+        counter,
+        [=]() { DeliverSector(); }
+    );
+}
+
+void Cdc::StopReading()
+{
+    if (m_emulator->m_scheduler->EventActive(Scheduler::Event::Type::CdSector)) {
+        m_emulator->m_scheduler->RemoveEvent(Scheduler::Event::Type::CdSector);
+    }
+}
+
+bool Cdc::ReadSector()
+{
+    const size_t sector = TimecodeToSector(m_drive_timecode);
+
+    if (sector >= DiscSectors) {
         Error("timecode past end of disk");
     }
 
+    if (!m_disc) {
+        Error("read with no disc inserted");
+    }
+
     //spdlog::debug("delivering sector {:02}:{:02}:{:02}", mm, ss, ff);
     //spdlog::debug("lba = 0x{:x}", sector);
 
-    m_disc->Read(m_sector_buffer.data(), sector);
+    const uint8_t *view = m_disc->View(sector);
+
+    if (view == nullptr) {
+        if (!m_disc->TryRead(m_sector_buffer.data(), sector)) {
+            return false;
+        }
+
+        view = m_sector_buffer.data();
+    }
+
+    m_sector = view;
 
     if (++m_drive_timecode.sector >= 75) {
         m_drive_timecode.sector = 0;
@@ -529,6 +754,44 @@ void Cdc::DeliverDataSector()
         }
     }
 
+    return true;
+}
+
+void Cdc::DeliverSector()
+{
+    /* rather than stall the machine on the host's disc, look again a little later */
+    if (!ReadSector()) {
+        m_emulator->m_scheduler->RescheduleEvent(
+            Scheduler::Event::Type::CdSector,
+            SectorPeriod() / 16
+        );
+
+        return;
+    }
+
+    if (m_stat.drive_state == DriveState::Playing) {
+        DeliverAudioSector();
+    } else {
+        DeliverDataSector();
+    }
+
+    m_emulator->m_scheduler->RescheduleEvent(
+        Scheduler::Event::Type::CdSector,
+        SectorPeriod()
+    );
+}
+
+void Cdc::DeliverDataSector()
+{
+    /* realtime audio goes to the decoder instead of the host */
+    if (m_mode.xa_adpcm && IsXaAudioSector()) {
+        if (!m_mode.xa_filter || (m_sector[16] == m_filter_file && m_sector[17] == m_filter_channel)) {
+            PlayXaSector();
+        }
+
+        return;
+    }
+
     m_response_fifo[0] = m_stat.raw;
 
     m_response_fifo_size = 1;
@@ -544,14 +807,70 @@ void Cdc::DeliverDataSector()
     }   
 }
 
+void Cdc::DeliverAudioSector()
+{
+    if (m_muted) {
+        return;
+    }
+
+    /* cd-da sectors are already 588 frames of 44.1 kHz stereo */
+    const size_t frames = DiscSectorSize / 4;
+
+    std::memcpy(m_audio_buffer.data(), m_sector, DiscSectorSize);
+    MixAudio(frames);
+}
+
+bool Cdc::IsXaAudioSector() const
+{
+    /* a mode 2 sector whose submode has both the audio and realtime bits */
+    return m_sector[15] == 0x2 && (m_sector[18] & 0x44) == 0x44;
+}
+
+void Cdc::PlayXaSector()
+{
+    /* decode even when muted so the filter history stays continuous */
+    const size_t frames = m_xa_adpcm.DecodeSector(m_sector, m_audio_buffer.data());
+
+    if (m_muted || m_adpcm_muted) {
+        return;
+    }
+
+    MixAudio(frames);
+}
+
+void Cdc::MixAudio(size_t frames)
+{
+    int16_t *samples = m_audio_buffer.data();
+
+    for (size_t i = 0; i < frames; ++i) {
+        const int32_t l = samples[2 * i];
+        const int32_t r = samples[2 * i + 1];
+
+        const int32_t mixed_l = (l * m_volume.l_to_l + r * m_volume.r_to_l) >> 7;
+        const int32_t mixed_r = (r * m_volume.r_to_r + l * m_volume.l_to_r) >> 7;
+
+        samples[2 * i] = std::clamp(mixed_l, INT16_MIN, INT16_MAX);
+        samples[2 * i + 1] = std::clamp(mixed_r, INT16_MIN, INT16_MAX);
+    }
+
+    m_emulator->m_spu->PushCdAudio(samples, frames);
+}
+
 void Cdc::FillDataFifo()
 {
     const size_t start = (m_mode.sector_size == SectorSize::WholeSector) ? 12 : 24;
     const size_t length = (m_mode.sector_size == SectorSize::WholeSector) ? 2340 : 2048;
 
-    std::memcpy(m_data_fifo.data(), &m_sector_buffer[start], length);
+    /* the buffered copy is overwritten by the next sector, a view is not */
+    if (m_sector == m_sector_buffer.data()) {
+        std::memcpy(m_data_fifo.data(), &m_sector[start], length);
+        m_data = m_data_fifo.data();
+    } else {
+        m_data = &m_sector[start];
+    }
 
     m_data_fifo_size = length;
+    m_data_fifo_position = 0;
     m_status.drqsts = true;
 }
 
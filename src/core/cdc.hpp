@@ -7,6 +7,9 @@
 #include <memory>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
+
+#include "xa_adpcm.hpp"
 
 #include "disc/disc.hpp"
 
@@ -17,16 +20,16 @@ class Emulator;
 
 class Cdc {
 public:
-    Cdc(Emulator *emulator, const std::filesystem::path& disc);
+    Cdc(Emulator *emulator, const std::filesystem::path& disc, DiscAccess access);
 
     void Reset();
-
-    void Tick();
+    void DoState(Serializer& s);
 
     uint8_t Read(uint32_t addr);
     void Write(uint32_t addr, uint8_t data);
 
     uint32_t ReadDma();
+    void ReadDmaBlock(uint32_t *data, size_t words);
 
 private:
     void ExecuteCommand();
@@ -34,7 +37,38 @@ private:
 
     void ExecuteTestCommand();
 
+    struct Timecode {
+        uint8_t minute, second, sector;
+    };
+
+    enum class DriveState : uint8_t {
+        None,
+        Reading,
+        Seeking,
+        Playing = 0x4
+    };
+
+    static size_t TimecodeToSector(const Timecode& timecode);
+    static Timecode SectorToTimecode(size_t sector);
+
+    /* sets the response to an error with the given reason, returning the interrupt it raises */
+    uint8_t ErrorResponse(uint8_t reason);
+
+    int64_t SectorPeriod() const;
+    int64_t SeekPeriod(const Timecode& from, const Timecode& to) const;
+
+    void ScheduleSecondResponse(int64_t ticks);
+    void StartReading(DriveState state);
+    void StopReading();
+
+    bool ReadSector();
+    void DeliverSector();
     void DeliverDataSector();
+    void DeliverAudioSector();
+
+    bool IsXaAudioSector() const;
+    void PlayXaSector();
+    void MixAudio(size_t frames);
 
     void FillDataFifo();
 
@@ -42,6 +76,8 @@ private:
     static constexpr size_t ResponseFifoSize = 16;
 
     static constexpr size_t DiscSectorSize = 2352;
+    static constexpr size_t DiscSectors = 80 * 60 * 75;
+    static constexpr size_t LeadInSectors = 150;
 
     union {
         uint8_t raw;
@@ -55,13 +91,6 @@ private:
         BitField<uint8_t, bool, 7, 1> busysts;
     } m_status;
 
-    enum class DriveState : uint8_t {
-        None,
-        Reading,
-        Seeking,
-        Playing = 0x4
-    };
-
     union {
         uint8_t raw;
 
@@ -93,30 +122,28 @@ private:
         Sync,
         GetStat,
         SetLoc,
+        Play,
         ReadN = 0x6,
         Pause = 0x9,
         Init,
-        Demute = 0xc,
-        SetMode = 0xe,
+        Mute,
+        Demute,
+        SetFilter,
+        SetMode,
         GetTn = 0x13,
+        GetTd,
         SeekL = 0x15,
         Test = 0x19,
         GetId = 0x1a,
+        ReadS,
     };
 
-    struct Timecode {
-        uint8_t minute, second, sector;
-    } m_setloc_timecode, m_drive_timecode;
+    Timecode m_setloc_timecode, m_drive_timecode;
 
     bool m_setloc_unprocessed;
 
     Command m_command;
-    size_t m_command_counter;
-
     Command m_command2;
-    size_t m_command2_counter;
-
-    size_t m_sector_counter;
 
     size_t m_parameter_fifo_size;
     std::array<uint8_t, ParameterFifoSize> m_parameter_fifo;
@@ -124,13 +151,28 @@ private:
     size_t m_response_fifo_size;
     std::array<uint8_t, ResponseFifoSize> m_response_fifo;
 
-    size_t m_data_fifo_size;
+    size_t m_data_fifo_size, m_data_fifo_position;
     std::array<uint8_t, DiscSectorSize> m_data_fifo;
 
     std::array<uint8_t, DiscSectorSize> m_sector_buffer;
 
+    /* point into the disc's own storage when it offers views, else at the copies above */
+    const uint8_t *m_sector, *m_data;
+
     uint8_t m_interrupt_enables, m_interrupt_flags;
 
+    uint8_t m_filter_file, m_filter_channel;
+
+    /* how much of each cd channel reaches each spu input, 0x80 is unity */
+    struct AudioVolume {
+        uint8_t l_to_l, l_to_r, r_to_r, r_to_l;
+    } m_volume, m_pending_volume;
+
+    bool m_muted, m_adpcm_muted;
+
+    XaAdpcm m_xa_adpcm;
+    std::array<int16_t, 2 * XaAdpcm::MaxFrames> m_audio_buffer;
+
     std::unique_ptr<Disc> m_disc;
     Emulator *m_emulator;
 };
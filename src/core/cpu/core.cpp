@@ -40,6 +40,29 @@ void Core::Reset()
     }
 }
 
+void Core::DoState(Serializer& s)
+{
+    s.Section("CPU ");
+
+    s.Do(m_pc);
+    s.Do(m_current_pc);
+    s.Do(m_next_pc);
+    s.Do(m_gpr);
+    s.Do(m_hi);
+    s.Do(m_lo);
+    s.Do(m_branch);
+    s.Do(m_branch_delay);
+
+    s.Do(m_status);
+    s.Do(m_cause);
+    s.Do(m_epc);
+
+    s.Do(m_cache_enabled);
+    s.Do(m_instruction_cache);
+
+    m_gte.DoState(s);
+}
+
 int Core::Run()
 {
     if ((m_pc & 0x3) != 0) {
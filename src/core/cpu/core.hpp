@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
 #include <common/types.hpp>
 
 #include "decode.hpp"
@@ -37,6 +38,7 @@ public:
     Core(Bus *bus);
 
     void Reset();
+    void DoState(Serializer& s);
 
     int Run();
     int RunRecompiler();
@@ -63,6 +65,10 @@ public:
         m_next_pc = value + 4;
     }
 
+    /* drop compiled code covering physical ram that has been written */
+    inline void InvalidateCode(u32 address) { m_recompiler->InvalidateAddress(address); }
+    inline void InvalidateCode(u32 address, std::size_t size) { m_recompiler->InvalidateRange(address, size); }
+
     inline u32 * Gpr() { return m_gpr.data(); }
 
 private:
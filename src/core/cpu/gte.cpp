@@ -66,6 +66,46 @@ u32 Gte::DecompressColour() const
     return irx | iry | irz;
 }
 
+void Gte::DoState(Serializer& s)
+{
+    s.Do(m_lm);
+    s.Do(m_tv);
+    s.Do(m_mv);
+    s.Do(m_mx);
+    s.Do(m_sf);
+
+    s.Do(m_v);
+    s.Do(m_colour);
+    s.Do(m_otz);
+    s.Do(m_ir0);
+    s.Do(m_ir);
+    s.Do(m_sx);
+    s.Do(m_sy);
+    s.Do(m_sz);
+    s.Do(m_rgb);
+    s.Do(m_res);
+    s.Do(m_mac0);
+    s.Do(m_mac);
+    s.Do(m_lzcs);
+    s.Do(m_lzcr);
+
+    s.Do(m_rt);
+    s.Do(m_llm);
+    s.Do(m_lcm);
+    s.Do(m_tr);
+    s.Do(m_bk);
+    s.Do(m_fc);
+
+    s.Do(m_ofx);
+    s.Do(m_ofy);
+    s.Do(m_h);
+    s.Do(m_dqa);
+    s.Do(m_dqb);
+    s.Do(m_zsf3);
+    s.Do(m_zsf4);
+    s.Do(m_flags);
+}
+
 u32 Gte::ReadData(std::size_t index) const
 {
     switch (index) {
@@ -6,6 +6,7 @@
 #include <utility>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
 #include <common/types.hpp>
 
 namespace Cpu
@@ -15,6 +16,8 @@ class Gte {
 public:
     void Execute(u32 i);
 
+    void DoState(Serializer& s);
+
     u32 ReadData(std::size_t index) const;
     void WriteData(std::size_t index, u32 value);
 
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cassert>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
@@ -16,25 +18,6 @@
 namespace Cpu
 {
 
-using BlockEntryFn = int (*)(Core *);
-
-struct Block {
-    BlockEntryFn entry;
-    int bytes;
-    u32 guest_address;
-    int guest_instructions;
-    bool valid;
-};
-
-static constexpr size_t kRamSize   = 2 * 1024 * 1024;
-static constexpr size_t kBiosSize  = 512 * 1024;
-
-static constexpr size_t kPageShift = 12;
-static constexpr size_t kPageMask  = (1 << kPageShift) - 1;
-
-static Block gRecompilerBlocks[(kRamSize + kBiosSize) >> 2];
-static std::vector<Block *> gRecompilerPages[kRamSize >> kPageShift];
-
 using namespace Xbyak::util;
 
 Recompiler::Recompiler(Bus *bus, Core *cpu, size_t cache_size)
@@ -44,14 +27,14 @@ int Recompiler::Run(u32 address)
 {
     size_t block_index = Core::TranslateAddress(address);
 
-    if (block_index > kRamSize) {
-        assert((address >= 0x1fc00000) && (address < (0x1fc00000 + kBiosSize)));
-        block_index -= 0x1fc00000 - kRamSize;
+    if (block_index > RamSize) {
+        assert((address >= 0x1fc00000) && (address < (0x1fc00000 + BiosSize)));
+        block_index -= 0x1fc00000 - RamSize;
     }
 
-    Block& block = gRecompilerBlocks[block_index >> 2];
+    Block& block = LookupBlock(block_index >> 2);
 
-    if (!block.valid) {
+    if (!block.entry) {
         printf("recompiling block at 0x%08x\n", address);
         CompileBlock(block, address);
     }
@@ -66,49 +49,81 @@ int Recompiler::Run(u32 address)
     return block.guest_instructions;
 }
 
+Block& Recompiler::LookupBlock(size_t index)
+{
+    std::unique_ptr<BlockChunk>& chunk = m_blocks[index / ChunkBlocks];
+
+    if (!chunk) {
+        chunk = std::make_unique<BlockChunk>();
+    }
+
+    return (*chunk)[index % ChunkBlocks];
+}
+
 void Recompiler::ClearCache()
 {
     m_cache.Flush();
-    std::memset(gRecompilerBlocks, 0, sizeof(gRecompilerBlocks));
-    for (size_t i = 0; i < (kRamSize >> kPageShift); ++i) gRecompilerPages[i].clear();
+
+    for (auto& chunk : m_blocks) chunk.reset();
+    for (auto& page : m_pages) page.clear();
 }
 
 void Recompiler::InvalidateAddress(u32 address)
 {
-    if (address >= kRamSize) {
+    if (address >= RamSize) {
         printf("invalidating invalid block at 0x%08x\n", address);
         std::abort();
     }
 
-    const size_t page = address >> kPageShift;
+    const size_t page = address >> PageShift;
+
+    /* InvalidateBlock erases from the page lists, so walk a copy taken off this one */
+    const std::vector<Block *> blocks = std::move(m_pages[page]);
+    m_pages[page].clear();
 
     //printf("invalidating block at 0x%08x : page %lu\n", address, page);
-    for (Block *block : gRecompilerPages[page]) InvalidateBlock(*block);
-    gRecompilerPages[page].clear();
+    for (Block *block : blocks) InvalidateBlock(*block);
+
+    assert(std::all_of(blocks.begin(), blocks.end(), [](const Block *block) { return !block->entry; }));
+}
+
+void Recompiler::InvalidateRange(u32 address, size_t size)
+{
+    if (size == 0) {
+        return;
+    }
+
+    const u32 start = address >> PageShift;
+    const u32 end = (address + size - 1) >> PageShift;
+
+    for (u32 page = start; page <= end; ++page) InvalidateAddress(page << PageShift);
 }
 
 void Recompiler::AddBlockRange(Block& block, u32 address, int size)
 {
-    if (address >= kRamSize) {
+    if (address >= RamSize) {
         printf("adding block range at invalid address 0x%08x\n", address);
         std::abort();
     }
 
-    const u32 start = address >> kPageShift;
-    const u32 end = start + (((size + kPageMask) & ~kPageMask) >> kPageShift);
+    const u32 start = address >> PageShift;
+    const u32 end = (address + size - 1) >> PageShift;
 
-    for (u32 i = start; i < end; ++i) gRecompilerPages[i].push_back(&block);
+    for (u32 i = start; i <= end; ++i) m_pages[i].push_back(&block);
 }
 
 void Recompiler::InvalidateBlock(Block& block)
 {
-    block.valid = false;
+    block.entry = nullptr;
+
+    /* the same physical pages the block was registered on */
+    const u32 phys = Core::TranslateAddress(block.guest_address);
 
-    const u32 start = block.guest_address >> kPageShift;
-    const u32 end = start + (((block.guest_instructions + kPageMask) & ~kPageMask) >> kPageShift);
+    const u32 start = phys >> PageShift;
+    const u32 end = (phys + 4 * block.guest_instructions - 1) >> PageShift;
 
-    for (u32 i = start; i < end; ++i) {
-        auto& vec = gRecompilerPages[i];
+    for (u32 i = start; i <= end; ++i) {
+        auto& vec = m_pages[i];
         auto found = std::find(vec.begin(), vec.end(), &block);
         if (found != vec.end()) vec.erase(found);
     }
@@ -152,14 +167,12 @@ void Recompiler::CompileBlock(Block& block, u32 address)
     m_cache.Commit(e.getSize());
 
     block.entry = e.getCode<BlockEntryFn>();
-    block.bytes = e.getSize();
     block.guest_instructions = instructions;
-    block.valid = true;
 
     const u32 phys = Core::TranslateAddress(block.guest_address);
-    if (phys < kRamSize) AddBlockRange(block, phys, instructions * 4);
+    if (phys < RamSize) AddBlockRange(block, phys, instructions * 4);
 
-   // for (int i = 0; i < block.bytes; ++i) {
+   // for (int i = 0; i < e.getSize(); ++i) {
    //     const u8 data = reinterpret_cast<u8 *>(block.entry)[i];
    //     printf("\\x%02x", data);
    // }
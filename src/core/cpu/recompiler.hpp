@@ -1,5 +1,9 @@
 #pragma once
 
+#include <array>
+#include <memory>
+#include <vector>
+
 #include <common/types.hpp>
 #include <xbyak/xbyak.h>
 
@@ -9,22 +13,45 @@ namespace Cpu
 {
 
 class Bus;
-class Block;
 class Core;
 
+using BlockEntryFn = int (*)(Core *);
+
+/* a null entry marks a block that has to be compiled before it runs */
+struct Block {
+    BlockEntryFn entry;
+    u32 guest_address;
+    u32 guest_instructions;
+};
+
 class Recompiler {
 public:
     Recompiler(Bus *bus, Core *cpu, size_t cache_size);
 
     int Run(u32 address);
 
-    static void InvalidateAddress(u32 address);
+    void InvalidateAddress(u32 address);
+    void InvalidateRange(u32 address, size_t size);
 
     void ClearCache();
 
 private:
+    static constexpr size_t RamSize = 2 * 1024 * 1024;
+    static constexpr size_t BiosSize = 512 * 1024;
+
+    static constexpr size_t PageShift = 12;
+    static constexpr size_t PageMask = (1 << PageShift) - 1;
+
+    /* one block slot per instruction, in a chunk per page allocated on first use */
+    static constexpr size_t ChunkBlocks = (1 << PageShift) >> 2;
+    static constexpr size_t ChunkCount = (RamSize + BiosSize) >> PageShift;
+
+    using BlockChunk = std::array<Block, ChunkBlocks>;
+
+    Block& LookupBlock(size_t index);
+
     void AddBlockRange(Block& block, u32 address, int size);
-    static void InvalidateBlock(Block& block);
+    void InvalidateBlock(Block& block);
 
     using Emitter = Xbyak::CodeGenerator;
 
@@ -117,6 +144,11 @@ private:
     Bus *m_bus;
     Core *m_cpu;
     CodeBuffer m_cache;
+
+    std::array<std::unique_ptr<BlockChunk>, ChunkCount> m_blocks;
+
+    /* blocks overlapping each page of ram */
+    std::array<std::vector<Block *>, (RamSize >> PageShift)> m_pages;
 };
 
 }
@@ -17,6 +17,8 @@ void Bin::Open(const std::filesystem::path& filepath)
     if (!m_disc.is_open()) {
         Error("unable to open {}", filepath.filename().string());
     }
+
+    m_sectors = std::filesystem::file_size(filepath) / SectorSize;
 }
 
 void Bin::Close()
@@ -32,6 +34,9 @@ void Bin::Read(void *buffer, size_t sector)
 
     //spdlof::info("seek=0x{:x}", SectorSize * (sector - PreGapSectors));
 
+    /* a short read past the end must not poison later seeks */
+    m_disc.clear();
+
     m_disc.seekg(SectorSize * (sector - PreGapSectors));
     m_disc.read(reinterpret_cast<char *>(buffer), SectorSize);
 }
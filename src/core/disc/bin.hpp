@@ -18,6 +18,8 @@ public:
     void Open(const std::filesystem::path& filepath) override;
     void Close() override;
 
+    size_t SectorCount() const override { return m_sectors; }
+
     void Read(void *buffer, size_t sector) override;
 
 private:
@@ -25,6 +27,7 @@ private:
     static constexpr size_t SectorSize = 2352;
 
     std::ifstream m_disc;
+    size_t m_sectors;
 };
 
 }
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#if defined(BTPSX_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include "../error.hpp"
+#include "compressed_bin.hpp"
+
+namespace Core
+{
+
+void CompressedBin::Open(const std::filesystem::path& filepath)
+{
+    m_disc.open(filepath, std::ios::binary);
+
+    if (!m_disc.is_open()) {
+        Error("unable to open {}", filepath.filename().string());
+    }
+
+    m_disc.read(reinterpret_cast<char *>(&m_header), sizeof(m_header));
+
+    if (!m_disc || std::memcmp(m_header.magic, Magic, sizeof(Magic)) != 0) {
+        Error("{} is not a compressed disc image", filepath.filename().string());
+    }
+
+    if (m_header.version != Version) {
+        Error("unsupported compressed disc version {}", m_header.version);
+    }
+
+    if (m_header.hunk_sectors == 0 || m_header.hunk_sectors > MaxHunkSectors ||
+        m_header.hunks != (size_t(m_header.sectors) + m_header.hunk_sectors - 1) / m_header.hunk_sectors) {
+        Error("corrupt compressed disc header");
+    }
+
+    m_hunks.resize(m_header.hunks);
+    m_disc.read(reinterpret_cast<char *>(m_hunks.data()), m_hunks.size() * sizeof(HunkEntry));
+
+    if (!m_disc) {
+        Error("truncated compressed disc index");
+    }
+
+    m_cache.clear();
+
+    for (size_t i = 0; i < CachedHunks; ++i) {
+        m_cache.push_back({ NoHunk, std::vector<uint8_t>(m_header.hunk_sectors * SectorSize) });
+    }
+}
+
+void CompressedBin::Close()
+{
+    m_disc.close();
+
+    m_hunks.clear();
+    m_cache.clear();
+}
+
+const CompressedBin::Hunk& CompressedBin::LoadHunk(size_t index)
+{
+    auto it = std::find_if(m_cache.begin(), m_cache.end(),
+        [index](const Hunk& hunk) { return hunk.index == index; });
+
+    if (it != m_cache.end()) {
+        m_cache.splice(m_cache.begin(), m_cache, it);
+        return m_cache.front();
+    }
+
+    /* evict the least recently used hunk */
+    m_cache.splice(m_cache.begin(), m_cache, std::prev(m_cache.end()));
+
+    Hunk& hunk = m_cache.front();
+    const HunkEntry& entry = m_hunks[index];
+
+    /* the last hunk may be short */
+    const size_t length = std::min<size_t>(m_header.hunk_sectors,
+        m_header.sectors - index * m_header.hunk_sectors) * SectorSize;
+
+    hunk.index = NoHunk;
+
+    m_compressed.resize(entry.size);
+
+    m_disc.clear();
+    m_disc.seekg(entry.offset);
+    m_disc.read(reinterpret_cast<char *>(m_compressed.data()), entry.size);
+
+    if (!m_disc) {
+        Error("truncated compressed disc hunk {}", index);
+    }
+
+    switch (entry.codec) {
+    case Codec::Stored:
+        if (entry.size != length) {
+            Error("corrupt stored hunk {}", index);
+        }
+
+        std::memcpy(hunk.data.data(), m_compressed.data(), length);
+        break;
+
+#if defined(BTPSX_HAVE_ZLIB)
+    case Codec::Zlib: {
+        uLongf size = length;
+
+        if (uncompress(hunk.data.data(), &size, m_compressed.data(), entry.size) != Z_OK || size != length) {
+            Error("corrupt zlib hunk {}", index);
+        }
+
+        break;
+    }
+#endif
+
+    default:
+        Error("unsupported codec {} in hunk {}", entry.codec, index);
+    }
+
+    hunk.index = index;
+
+    return hunk;
+}
+
+void CompressedBin::Read(void *buffer, size_t sector)
+{
+    if (sector < PreGapSectors) {
+        Error("attempt to read pre-gap");
+    }
+
+    const size_t lba = sector - PreGapSectors;
+
+    if (lba >= m_header.sectors) {
+        Error("attempt to read past end of disc");
+    }
+
+    const Hunk& hunk = LoadHunk(lba / m_header.hunk_sectors);
+    const size_t offset = (lba % m_header.hunk_sectors) * SectorSize;
+
+    std::memcpy(buffer, hunk.data.data() + offset, SectorSize);
+}
+
+}
@@ -0,0 +1,88 @@
+#ifndef CORE_DISC_COMPRESSED_BIN_HPP
+#define CORE_DISC_COMPRESSED_BIN_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <list>
+#include <vector>
+
+#include "disc.hpp"
+
+namespace Core
+{
+
+/*
+ * A raw image split into fixed size hunks of sectors, each compressed
+ * on its own. A hunk index follows the header so that any sector is one
+ * seek away, and a handful of decoded hunks are kept around since reads
+ * are mostly sequential.
+ */
+class CompressedBin : public Disc {
+public:
+    static constexpr size_t SectorSize = 2352;
+    static constexpr uint32_t Version = 1;
+
+    /* bounds the decode buffers a header can ask for */
+    static constexpr uint32_t MaxHunkSectors = 64;
+
+    static constexpr char Magic[8] = { 'B', 'T', 'P', 'S', 'X', 'C', 'D', '\0' };
+
+    enum Codec : uint8_t { Stored, Zlib };
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t hunk_sectors;
+        uint32_t sectors;
+        uint32_t hunks;
+    };
+
+    struct HunkEntry {
+        uint64_t offset;
+        uint32_t size;
+        uint8_t codec;
+        uint8_t reserved[3];
+    };
+#pragma pack(pop)
+
+    CompressedBin(const std::filesystem::path& filepath) { Open(filepath); }
+    ~CompressedBin() override { Close(); }
+
+    void Open(const std::filesystem::path& filepath) override;
+    void Close() override;
+
+    size_t SectorCount() const override { return m_header.sectors; }
+
+    void Read(void *buffer, size_t sector) override;
+
+private:
+    static constexpr size_t PreGapSectors = 150;
+    static constexpr size_t CachedHunks = 4;
+
+    static constexpr size_t NoHunk = SIZE_MAX;
+
+    struct Hunk {
+        size_t index;
+        std::vector<uint8_t> data;
+    };
+
+    const Hunk& LoadHunk(size_t index);
+
+    std::ifstream m_disc;
+
+    Header m_header;
+    std::vector<HunkEntry> m_hunks;
+
+    std::vector<uint8_t> m_compressed;
+
+    /* most recently used at the front */
+    std::list<Hunk> m_cache;
+};
+
+}
+
+#endif /* CORE_DISC_COMPRESSED_BIN_HPP */
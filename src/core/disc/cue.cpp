@@ -0,0 +1,190 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "../error.hpp"
+#include "cue.hpp"
+
+namespace Core
+{
+
+static size_t ParseTimecode(const std::string& timecode)
+{
+    unsigned minute, second, frame;
+    char colon1, colon2;
+
+    std::istringstream stream(timecode);
+    stream >> minute >> colon1 >> second >> colon2 >> frame;
+
+    if (!stream || colon1 != ':' || colon2 != ':' || second >= 60 || frame >= 75) {
+        Error("malformed cue timecode {}", timecode);
+    }
+
+    return 75 * (60 * minute + second) + frame;
+}
+
+void Cue::Open(const std::filesystem::path& filepath)
+{
+    std::ifstream cue(filepath);
+
+    if (!cue.is_open()) {
+        Error("unable to open {}", filepath.filename().string());
+    }
+
+    m_files.clear();
+    m_extents.clear();
+    m_tracks.clear();
+
+    /* the extent being built runs from segment_sector of the current file */
+    size_t lba = 0, segment_sector = 0, file_sectors = 0;
+    size_t pending_gap = 0;
+    bool track_started = true;
+
+    const auto close_extent = [&](size_t end_sector) {
+        if (!m_files.empty() && end_sector > segment_sector) {
+            m_extents.push_back({ lba, end_sector - segment_sector,
+                                  m_files.size() - 1, segment_sector });
+            lba += end_sector - segment_sector;
+        }
+
+        segment_sector = end_sector;
+    };
+
+    std::string line;
+
+    while (std::getline(cue, line)) {
+        std::istringstream stream(line);
+        std::string command;
+
+        stream >> command;
+
+        if (command == "FILE") {
+            close_extent(file_sectors);
+
+            std::string name;
+            stream >> std::ws;
+
+            if (stream.peek() == '"') {
+                stream.get();
+                std::getline(stream, name, '"');
+            } else {
+                stream >> name;
+            }
+
+            std::string type;
+            stream >> type;
+
+            if (type != "BINARY") {
+                Error("unsupported cue file type {}", type);
+            }
+
+            const std::filesystem::path path = filepath.parent_path() / name;
+
+            m_files.emplace_back(path, std::ios::binary);
+
+            if (!m_files.back().is_open()) {
+                Error("unable to open {}", path.filename().string());
+            }
+
+            file_sectors = std::filesystem::file_size(path) / SectorSize;
+            segment_sector = 0;
+        } else if (command == "TRACK") {
+            std::string number, mode;
+            stream >> number >> mode;
+
+            if (mode != "AUDIO" && mode != "MODE1/2352" && mode != "MODE2/2352") {
+                Error("unsupported cue track mode {}", mode);
+            }
+
+            if (std::stoul(number) != m_tracks.size() + 1) {
+                Error("cue track {} out of order", number);
+            }
+
+            track_started = false;
+        } else if (command == "PREGAP") {
+            std::string length;
+            stream >> length;
+
+            pending_gap += ParseTimecode(length);
+        } else if (command == "POSTGAP") {
+            std::string length;
+            stream >> length;
+
+            /* lands after the current track, which is cut at the next index */
+            pending_gap += ParseTimecode(length);
+        } else if (command == "INDEX") {
+            std::string number, offset;
+            stream >> number >> offset;
+
+            if (m_files.empty()) {
+                Error("cue index before file");
+            }
+
+            const size_t sector = ParseTimecode(offset);
+
+            if (pending_gap != 0) {
+                close_extent(sector);
+
+                lba += pending_gap;
+                pending_gap = 0;
+            }
+
+            /* a track is played from index 01, after any index 00 pause */
+            if (std::stoul(number) == 1 && !track_started) {
+                m_tracks.push_back(lba + sector - segment_sector);
+                track_started = true;
+            }
+        }
+    }
+
+    close_extent(file_sectors);
+
+    m_sectors = lba + pending_gap;
+
+    if (m_extents.empty() || m_tracks.empty()) {
+        Error("cue sheet {} describes no data", filepath.filename().string());
+    }
+}
+
+void Cue::Close()
+{
+    m_files.clear();
+    m_extents.clear();
+    m_tracks.clear();
+    m_sectors = 0;
+}
+
+void Cue::Read(void *buffer, size_t sector)
+{
+    if (sector < PreGapSectors) {
+        Error("attempt to read pre-gap");
+    }
+
+    const size_t lba = sector - PreGapSectors;
+
+    if (lba >= m_sectors) {
+        Error("attempt to read past end of disc");
+    }
+
+    const auto extent = std::upper_bound(m_extents.begin(), m_extents.end(), lba,
+        [](size_t lba, const Extent& extent) { return lba < extent.lba; });
+
+    /* gaps between extents read back as silence */
+    if (extent == m_extents.begin() || lba >= std::prev(extent)->lba + std::prev(extent)->sectors) {
+        std::memset(buffer, 0, SectorSize);
+        return;
+    }
+
+    const Extent& e = *std::prev(extent);
+    std::ifstream& file = m_files[e.file];
+
+    file.clear();
+    file.seekg(SectorSize * (e.file_sector + lba - e.lba));
+    file.read(reinterpret_cast<char *>(buffer), SectorSize);
+}
+
+}
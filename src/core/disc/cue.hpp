@@ -0,0 +1,54 @@
+#ifndef CORE_DISC_CUE_HPP
+#define CORE_DISC_CUE_HPP
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "disc.hpp"
+
+namespace Core
+{
+
+/*
+ * A cue sheet describing one or more raw 2352 byte sector files. The
+ * tracks are laid end to end, and PREGAP/POSTGAP directives insert
+ * silent sectors that no file backs.
+ */
+class Cue : public Disc {
+public:
+    Cue(const std::filesystem::path& filepath) { Open(filepath); }
+    ~Cue() override { Close(); }
+
+    void Open(const std::filesystem::path& filepath) override;
+    void Close() override;
+
+    size_t SectorCount() const override { return m_sectors; }
+
+    size_t TrackCount() const override { return m_tracks.size(); }
+    size_t TrackStart(size_t track) const override { return PreGapSectors + m_tracks[track - 1]; }
+
+    void Read(void *buffer, size_t sector) override;
+
+private:
+    static constexpr size_t PreGapSectors = 150;
+    static constexpr size_t SectorSize = 2352;
+
+    /* a run of disc sectors stored contiguously in one file */
+    struct Extent {
+        size_t lba, sectors;
+        size_t file, file_sector;
+    };
+
+    std::vector<std::ifstream> m_files;
+    std::vector<Extent> m_extents;
+    size_t m_sectors;
+
+    /* where each track's index 01 lands, after the lead-in */
+    std::vector<size_t> m_tracks;
+};
+
+}
+
+#endif /* CORE_DISC_CUE_HPP */
@@ -2,11 +2,15 @@
 #define CORE_DISC_HPP
 
 #include <cstddef>
+#include <cstdint>
 #include <filesystem>
 
 namespace Core
 {
 
+/* how a raw .bin is read: through the read-ahead thread, or mapped where the platform allows */
+enum class DiscAccess { ReadAhead, Mapped };
+
 class Disc {
 public:
     virtual ~Disc() = 0;
@@ -14,7 +18,23 @@ public:
     virtual void Open(const std::filesystem::path& filepath) = 0;
     virtual void Close() = 0;
 
+    /* sectors after the 150 sector lead-in */
+    virtual size_t SectorCount() const = 0;
+
     virtual void Read(void *buffer, size_t sector) = 0;
+
+    /* reads sector only if it is at hand, otherwise starts fetching it and returns false */
+    virtual bool TryRead(void *buffer, size_t sector) { Read(buffer, sector); return true; }
+
+    /* tracks are numbered from 1; a plain image holds one data track after the lead-in */
+    virtual size_t TrackCount() const { return 1; }
+    virtual size_t TrackStart(size_t track) const { (void)track; return 150; }
+
+    /* hints that reads will soon start at sector, must not block */
+    virtual void Prefetch(size_t sector) { (void)sector; }
+
+    /* a sector that stays readable while the disc is open, or nullptr */
+    virtual const uint8_t * View(size_t sector) { (void)sector; return nullptr; }
 };
 
 }
@@ -0,0 +1,105 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../error.hpp"
+#include "mapped_bin.hpp"
+
+namespace Core
+{
+
+void MappedBin::Open(const std::filesystem::path& filepath)
+{
+    Close();
+
+    const int fd = open(filepath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        Error("unable to open {}", filepath.filename().string());
+    }
+
+    struct stat info;
+
+    if (fstat(fd, &info) < 0 || info.st_size == 0) {
+        close(fd);
+        Error("unable to stat {}", filepath.filename().string());
+    }
+
+    void *data = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        Error("unable to map {}", filepath.filename().string());
+    }
+
+    m_data = static_cast<const uint8_t *>(data);
+    m_size = info.st_size;
+    m_window_end = 0;
+
+    madvise(data, m_size, MADV_SEQUENTIAL);
+}
+
+void MappedBin::Close()
+{
+    if (m_data != nullptr) {
+        munmap(const_cast<uint8_t *>(m_data), m_size);
+    }
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+void MappedBin::Read(void *buffer, size_t sector)
+{
+    std::memcpy(buffer, View(sector), SectorSize);
+}
+
+void MappedBin::Prefetch(size_t sector)
+{
+    if (sector < PreGapSectors) {
+        return;
+    }
+
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+    const size_t start = SectorSize * (sector - PreGapSectors);
+    const size_t end = std::min(start + SectorSize * WindowSectors, m_size);
+
+    if (start >= end) {
+        return;
+    }
+
+    const size_t aligned = start & ~(page_size - 1);
+    madvise(const_cast<uint8_t *>(m_data) + aligned, end - aligned, MADV_WILLNEED);
+
+    m_window_end = sector + WindowSectors;
+}
+
+const uint8_t * MappedBin::View(size_t sector)
+{
+    if (sector < PreGapSectors) {
+        Error("attempt to read pre-gap");
+    }
+
+    const size_t offset = SectorSize * (sector - PreGapSectors);
+
+    if (offset + SectorSize > m_size) {
+        Error("attempt to read past end of disc");
+    }
+
+    /* keep the kernel half a window ahead of the drive */
+    if (sector + WindowSectors / 2 >= m_window_end) {
+        Prefetch(sector + 1);
+    }
+
+    return m_data + offset;
+}
+
+}
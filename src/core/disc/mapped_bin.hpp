@@ -0,0 +1,42 @@
+#ifndef CORE_DISC_MAPPED_BIN_HPP
+#define CORE_DISC_MAPPED_BIN_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+#include "disc.hpp"
+
+namespace Core
+{
+
+/* a raw .bin image mapped read-only, so sectors come straight from the page cache */
+class MappedBin : public Disc {
+public:
+    MappedBin(const std::filesystem::path& filepath) { Open(filepath); }
+    ~MappedBin() override { Close(); }
+
+    void Open(const std::filesystem::path& filepath) override;
+    void Close() override;
+
+    size_t SectorCount() const override { return m_size / SectorSize; }
+
+    void Read(void *buffer, size_t sector) override;
+    void Prefetch(size_t sector) override;
+
+    const uint8_t * View(size_t sector) override;
+
+private:
+    static constexpr size_t PreGapSectors = 150;
+    static constexpr size_t SectorSize = 2352;
+    static constexpr size_t WindowSectors = 64;
+
+    const uint8_t *m_data = nullptr;
+    size_t m_size = 0;
+
+    size_t m_window_end = 0;
+};
+
+}
+
+#endif /* CORE_DISC_MAPPED_BIN_HPP */
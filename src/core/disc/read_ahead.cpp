@@ -0,0 +1,230 @@
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "../error.hpp"
+#include "read_ahead.hpp"
+
+namespace Core
+{
+
+ReadAhead::ReadAhead(std::unique_ptr<Disc> disc) : m_disc(std::move(disc))
+{
+    Start();
+}
+
+ReadAhead::~ReadAhead()
+{
+    Stop();
+}
+
+void ReadAhead::Open(const std::filesystem::path& filepath)
+{
+    Stop();
+    m_disc->Open(filepath);
+    Start();
+}
+
+void ReadAhead::Close()
+{
+    Stop();
+    m_disc->Close();
+}
+
+void ReadAhead::Read(void *buffer, size_t sector)
+{
+    /* nothing is left to fill the pool once closed */
+    if (!m_thread.joinable()) {
+        Error("read from a closed disc");
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    auto entry = m_index.find(sector);
+
+    while (entry == m_index.end()) {
+        m_demand = sector;
+        m_request.notify_one();
+
+        m_ready.wait(lock, [&]() { return m_error || m_index.count(sector) != 0; });
+        m_demand = NoSector;
+
+        if (m_error) {
+            std::rethrow_exception(std::exchange(m_error, nullptr));
+        }
+
+        entry = m_index.find(sector);
+    }
+
+    Serve(buffer, entry->second);
+}
+
+bool ReadAhead::TryRead(void *buffer, size_t sector)
+{
+    if (!m_thread.joinable()) {
+        Error("read from a closed disc");
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_error) {
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+    }
+
+    auto entry = m_index.find(sector);
+
+    if (entry == m_index.end()) {
+        /* demanded rather than windowed, so a failure comes back on the next try */
+        m_demand = sector;
+        m_request.notify_one();
+        return false;
+    }
+
+    if (m_demand == sector) {
+        m_demand = NoSector;
+    }
+
+    Serve(buffer, entry->second);
+    return true;
+}
+
+void ReadAhead::Prefetch(size_t sector)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    MoveWindow(sector);
+}
+
+void ReadAhead::Start()
+{
+    m_pool.clear();
+    m_index.clear();
+
+    m_stop = false;
+    m_demand = NoSector;
+    m_window_next = m_window_end = 0;
+    m_error = nullptr;
+
+    m_thread = std::thread(&ReadAhead::Run, this);
+}
+
+void ReadAhead::Stop()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_request.notify_one();
+    m_thread.join();
+}
+
+void ReadAhead::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::array<uint8_t, SectorSize> staging;
+
+    for (;;) {
+        size_t sector = NoSector;
+        bool demanded = false;
+
+        m_request.wait(lock, [&]() {
+            if (m_stop) {
+                return true;
+            }
+
+            if (m_demand != NoSector && m_index.count(m_demand) == 0) {
+                sector = m_demand;
+                demanded = true;
+                return true;
+            }
+
+            while (m_window_next < m_window_end && m_index.count(m_window_next) != 0) {
+                ++m_window_next;
+            }
+
+            if (m_window_next < m_window_end) {
+                sector = m_window_next++;
+                return true;
+            }
+
+            return false;
+        });
+
+        if (m_stop) {
+            return;
+        }
+
+        std::exception_ptr error;
+
+        /* the disc is only ever touched from this thread */
+        lock.unlock();
+
+        try {
+            m_disc->Read(staging.data(), sector);
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        lock.lock();
+
+        if (error) {
+            /* a failed read ahead most likely ran off the disc */
+            if (demanded) {
+                m_error = error;
+                m_demand = NoSector;
+                m_ready.notify_all();
+            } else {
+                m_window_next = m_window_end;
+            }
+
+            continue;
+        }
+
+        if (m_pool.size() < PoolSectors) {
+            m_pool.emplace_front();
+        } else {
+            m_index.erase(m_pool.back().sector);
+            m_pool.splice(m_pool.begin(), m_pool, std::prev(m_pool.end()));
+        }
+
+        m_pool.front().sector = sector;
+        m_pool.front().data = staging;
+        m_index[sector] = m_pool.begin();
+
+        if (m_demand != NoSector) {
+            m_ready.notify_all();
+        }
+    }
+}
+
+void ReadAhead::Serve(void *buffer, std::list<Buffer>::iterator entry)
+{
+    m_pool.splice(m_pool.begin(), m_pool, entry);
+    std::memcpy(buffer, entry->data.data(), SectorSize);
+
+    MoveWindow(entry->sector + 1);
+}
+
+void ReadAhead::MoveWindow(size_t sector)
+{
+    if (sector >= m_window_next && sector + WindowSectors <= m_window_end) {
+        return;
+    }
+
+    m_window_next = sector;
+    m_window_end = sector + WindowSectors;
+
+    m_request.notify_one();
+}
+
+}
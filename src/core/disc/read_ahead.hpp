@@ -0,0 +1,84 @@
+#ifndef CORE_DISC_READ_AHEAD_HPP
+#define CORE_DISC_READ_AHEAD_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#include "disc.hpp"
+
+namespace Core
+{
+
+/*
+ * Serves sectors for another disc from a pool of buffers filled by a
+ * background thread. Sequential reads keep a window of sectors ahead of
+ * the last one served, and the pool is recycled least recently used
+ * first so that re-reads after a seek usually hit.
+ */
+class ReadAhead : public Disc {
+public:
+    ReadAhead(std::unique_ptr<Disc> disc);
+    ~ReadAhead() override;
+
+    void Open(const std::filesystem::path& filepath) override;
+    void Close() override;
+
+    size_t SectorCount() const override { return m_disc->SectorCount(); }
+
+    size_t TrackCount() const override { return m_disc->TrackCount(); }
+    size_t TrackStart(size_t track) const override { return m_disc->TrackStart(track); }
+
+    void Read(void *buffer, size_t sector) override;
+    bool TryRead(void *buffer, size_t sector) override;
+    void Prefetch(size_t sector) override;
+
+private:
+    static constexpr size_t SectorSize = 2352;
+    static constexpr size_t PoolSectors = 1024;
+    static constexpr size_t WindowSectors = 64;
+
+    static constexpr size_t NoSector = SIZE_MAX;
+
+    struct Buffer {
+        size_t sector;
+        std::array<uint8_t, SectorSize> data;
+    };
+
+    void Start();
+    void Stop();
+
+    void Run();
+
+    void MoveWindow(size_t sector);
+    void Serve(void *buffer, std::list<Buffer>::iterator entry);
+
+    std::unique_ptr<Disc> m_disc;
+
+    std::mutex m_mutex;
+    std::condition_variable m_request, m_ready;
+
+    std::thread m_thread;
+    bool m_stop;
+
+    size_t m_demand;
+    size_t m_window_next, m_window_end;
+
+    std::exception_ptr m_error;
+
+    /* most recently used at the front */
+    std::list<Buffer> m_pool;
+    std::unordered_map<size_t, std::list<Buffer>::iterator> m_index;
+};
+
+}
+
+#endif /* CORE_DISC_READ_AHEAD_HPP */
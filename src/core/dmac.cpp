@@ -1,19 +1,35 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <spdlog/spdlog.h>
 
+#include "cpu/core.hpp"
+#include "cpu/recompiler.hpp"
+
 #include "cdc.hpp"
 #include "dmac.hpp"
 #include "emulator.hpp"
 #include "error.hpp"
 #include "gpu.hpp"
+#include "gpu_recorder.hpp"
 #include "intc.hpp"
+#include "mdec.hpp"
+#include "scheduler.hpp"
 #include "spu.hpp"
 
 namespace Core
 {
 
+static inline Scheduler::Event::Type TransferEvent(size_t channel)
+{
+    return static_cast<Scheduler::Event::Type>(Scheduler::Event::DmaMdecIn + channel);
+}
+
 Dmac::Dmac(Emulator *emulator) : m_emulator(emulator) {}
 
 void Dmac::Reset()
@@ -24,6 +40,28 @@ void Dmac::Reset()
 
     m_dpcr = 0x7654321;
     m_dicr.raw = 0;
+
+    for (size_t i = 0; i < Channel::Count; ++i) {
+        const Scheduler::Event::Type type = TransferEvent(i);
+
+        if (m_emulator->m_scheduler->EventActive(type)) {
+            m_emulator->m_scheduler->RemoveEvent(type);
+        }
+    }
+}
+
+void Dmac::DoState(Serializer& s)
+{
+    s.Section("DMAC");
+
+    s.Do(m_channels);
+    s.Do(m_dpcr);
+    s.Do(m_dicr);
+
+    for (size_t i = 0; i < Channel::Count; ++i) {
+        const Channel index = static_cast<Channel>(i);
+        m_emulator->m_scheduler->DoEvent(s, TransferEvent(i), [=]() { FinishTransfer(index); });
+    }
 }
 
 uint32_t Dmac::Read(uint32_t addr)
@@ -52,19 +90,13 @@ void Dmac::Write(uint32_t addr, uint32_t data)
     if (addr == 0x1f8010e8) {
         DmaChannel *channel = &m_channels[Channel::Otc];
 
+        FlushTransfer(Channel::Otc);
+
         channel->chcr.raw = data & 0x51000000;
         channel->chcr.backward = true;
 
         if (channel->chcr.enable && channel->chcr.start) {
-            StartTransferOtc();
-
-            if ((m_dicr.enable & (1 << Channel::Otc)) != 0) {
-                m_dicr.flag = m_dicr.flag | (1 << Channel::Otc);
-                UpdateInterrupts();
-            }
-
-            //spdlog::info("otc complete");
-            channel->chcr.raw &= ~0x11000000;
+            StartTransfer(Channel::Otc);
         }
 
         return;
@@ -94,33 +126,13 @@ void Dmac::Write(uint32_t addr, uint32_t data)
         channel->bcr.raw = data;
         break;
     case 0x8:
+        FlushTransfer(static_cast<Channel>(index));
+
         channel->chcr.raw = data & 0x71770703;
 
         if (channel->chcr.enable && (channel->chcr.start
             || (channel->chcr.sync_mode != SyncMode::Manual))) {
-            switch (index) {
-            case Channel::MdecIn:
-                StartTransferMdecIn();
-                break;
-            case Channel::Gpu:
-                StartTransferGpu();
-                break;
-            case Channel::Cdrom:
-                StartTransferCdrom();
-                break;
-            case Channel::Spu:
-                StartTransferSpu();
-                break;
-            default: Error("unsupported dma{}", index);
-            }
-
-            if ((m_dicr.enable & (1 << index)) != 0) {
-                m_dicr.flag = m_dicr.flag | (1 << index);
-                UpdateInterrupts();
-            }
-
-            //spdlog::info("dma{} complete", index);
-            channel->chcr.raw &= ~0x11000000;
+            StartTransfer(static_cast<Channel>(index));
         }
 
         break;
@@ -128,24 +140,244 @@ void Dmac::Write(uint32_t addr, uint32_t data)
     }
 }
 
-void Dmac::StartTransferMdecIn()
+void Dmac::Request(Channel index)
+{
+    if (m_channels[index].chcr.enable && !m_emulator->m_scheduler->EventActive(TransferEvent(index))) {
+        StartTransfer(index);
+    }
+}
+
+void Dmac::StartTransfer(Channel index)
+{
+    if (index == Channel::MdecOut) {
+        StartTransferMdecOut();
+        return;
+    }
+
+    DmaChannel *channel = &m_channels[index];
+    size_t words;
+
+    switch (index) {
+    case Channel::MdecIn:
+        words = StartTransferMdecIn();
+        break;
+    case Channel::Gpu:
+        words = StartTransferGpu();
+        break;
+    case Channel::Cdrom:
+        words = StartTransferCdrom();
+        break;
+    case Channel::Spu:
+        words = StartTransferSpu();
+        break;
+    case Channel::Otc:
+        words = StartTransferOtc();
+        break;
+    default: Error("unsupported dma{}", index);
+    }
+
+    /*
+     * the data moves up front, but the cpu loses the bus for as long as the
+     * transfer would hold it. in chopping mode the cpu gets its window back
+     * between bursts, so completion is pushed out rather than stalled.
+     */
+    const int64_t cycles = static_cast<int64_t>(words) * WordCycles[index];
+    int64_t delay = 0;
+
+    if (channel->chcr.chopping && channel->chcr.sync_mode == SyncMode::Manual) {
+        const size_t burst = size_t(1) << channel->chcr.dma_window;
+        const size_t bursts = (words + burst - 1) / burst;
+
+        if (bursts > 1) {
+            delay = static_cast<int64_t>(bursts - 1) << channel->chcr.cpu_window;
+        }
+    }
+
+    m_emulator->Tick(cycles);
+
+    m_emulator->m_scheduler->AddEvent(
+        TransferEvent(index),
+        Scheduler::Event::Mode::Once,
+        delay,
+        [=]() { FinishTransfer(index); }
+    );
+}
+
+void Dmac::FinishTransfer(Channel index)
+{
+    if (index == Channel::MdecOut) {
+        FinishTransferMdecOut();
+    }
+
+    if ((m_dicr.enable & (1 << index)) != 0) {
+        m_dicr.flag = m_dicr.flag | (1 << index);
+        UpdateInterrupts();
+    }
+
+    m_channels[index].chcr.raw &= ~0x11000000;
+}
+
+void Dmac::FlushTransfer(Channel index)
 {
-    spdlog::warn("unimplemented mdec in dma");
+    const Scheduler::Event::Type type = TransferEvent(index);
+
+    if (m_emulator->m_scheduler->EventActive(type)) {
+        m_emulator->m_scheduler->RemoveEvent(type);
+        FinishTransfer(index);
+    }
 }
 
-void Dmac::StartTransferGpu()
+void Dmac::StartTransferMdecOut()
+{
+    const DmaChannel *channel = &m_channels[Channel::MdecOut];
+
+    if (channel->chcr.direction != Direction::ToRam) {
+        Error("unimplemented mdec out dma direction");
+    }
+
+    /* wait for a decode to request the transfer */
+    if (!m_emulator->m_mdec->OutputPending()) {
+        return;
+    }
+
+    const size_t words = channel->bcr.size * channel->bcr.count;
+
+    m_emulator->m_scheduler->AddEvent(
+        TransferEvent(Channel::MdecOut),
+        Scheduler::Event::Mode::Once,
+        m_emulator->m_mdec->OutputCycles(words),
+        [=]() { FinishTransfer(Channel::MdecOut); }
+    );
+}
+
+void Dmac::FinishTransferMdecOut()
+{
+    const DmaChannel *channel = &m_channels[Channel::MdecOut];
+
+    uint32_t addr = channel->madr.address;
+    size_t words = channel->bcr.size * channel->bcr.count;
+
+    if (channel->chcr.backward) {
+        do {
+            uint32_t data;
+            m_emulator->m_mdec->ReadDmaBlock(&data, 1);
+            m_emulator->WriteWord(addr & 0x1ffffc, data);
+
+            addr -= 4;
+        } while (--words != 0);
+
+        return;
+    }
+
+    while (words != 0) {
+        const uint32_t offset = addr & 0x1ffffc;
+        const size_t span = std::min(words, (Emulator::RamSize - offset) / 4);
+
+        uint32_t *ram = reinterpret_cast<uint32_t *>(&m_emulator->m_ram[offset]);
+
+        m_emulator->m_mdec->ReadDmaBlock(ram, span);
+        m_emulator->RamWritten(offset, 4 * span);
+
+        addr += 4 * span;
+        words -= span;
+    }
+}
+
+size_t Dmac::StartTransferMdecIn()
+{
+    const DmaChannel *channel = &m_channels[Channel::MdecIn];
+
+    uint32_t addr = channel->madr.address;
+    size_t words = channel->bcr.size * channel->bcr.count;
+
+    const size_t total = words;
+
+    if (channel->chcr.direction != Direction::FromRam) {
+        Error("unimplemented mdec in dma direction");
+    }
+
+    if (channel->chcr.backward) {
+        do {
+            const uint32_t data = m_emulator->ReadWord(addr & 0x1ffffc);
+            m_emulator->m_mdec->WriteDmaBlock(&data, 1);
+
+            addr -= 4;
+        } while (--words != 0);
+
+        return total;
+    }
+
+    while (words != 0) {
+        const uint32_t offset = addr & 0x1ffffc;
+        const size_t span = std::min(words, (Emulator::RamSize - offset) / 4);
+
+        const uint32_t *ram = reinterpret_cast<const uint32_t *>(&m_emulator->m_ram[offset]);
+        m_emulator->m_mdec->WriteDmaBlock(ram, span);
+
+        addr += 4 * span;
+        words -= span;
+    }
+
+    return total;
+}
+
+size_t Dmac::StartTransferGpu()
 {
     const DmaChannel *channel = &m_channels[Channel::Gpu];
 
     uint32_t addr = channel->madr.address;
     size_t words = channel->bcr.size * channel->bcr.count;
 
+    const size_t total = words;
+
+    if (channel->chcr.sync_mode == SyncMode::Block && !channel->chcr.backward) {
+        while (words != 0) {
+            const uint32_t offset = addr & 0x1ffffc;
+            const size_t span = std::min(words, (Emulator::RamSize - offset) / 4);
+
+            uint32_t *ram = reinterpret_cast<uint32_t *>(&m_emulator->m_ram[offset]);
+
+            GpuRecorder *recorder = m_emulator->m_gpu_recorder.get();
+
+            if (channel->chcr.direction == Direction::FromRam) {
+                if (recorder) {
+                    recorder->Dma(ram, span);
+                }
+
+                m_emulator->m_gpu->Gp0Block(ram, span);
+            } else {
+                if (recorder) {
+                    recorder->Read(span);
+                }
+
+                m_emulator->m_gpu->GpuReadBlock(ram, span);
+                m_emulator->RamWritten(offset, 4 * span);
+            }
+
+            addr += 4 * span;
+            words -= span;
+        }
+
+        return total;
+    }
+
+    GpuRecorder *recorder = m_emulator->m_gpu_recorder.get();
+
     if (channel->chcr.sync_mode == SyncMode::Block) {
         do {
             if (channel->chcr.direction == Direction::FromRam) {
                 const uint32_t data = m_emulator->ReadWord(addr & 0x1ffffc);
+
+                if (recorder) {
+                    recorder->Gp0(data);
+                }
+
                 m_emulator->m_gpu->Gp0(data);
             } else {
+                if (recorder) {
+                    recorder->Read(1);
+                }
+
                 const uint32_t data = m_emulator->m_gpu->GpuRead();
                 m_emulator->WriteWord(addr & 0x1ffffc, data);
             }
@@ -153,7 +385,7 @@ void Dmac::StartTransferGpu()
             addr += channel->chcr.backward ? -4 : 4;
         } while (--words != 0);
 
-        return;
+        return total;
     }
 
     if (channel->chcr.direction != Direction::FromRam) {
@@ -164,15 +396,49 @@ void Dmac::StartTransferGpu()
         Error("unimplemented gpu dma sync mode");
     }
 
+    const uint32_t *ram = reinterpret_cast<const uint32_t *>(m_emulator->m_ram.data());
+
+    /* a well formed list cannot visit more nodes than ram holds words */
+    size_t budget = Emulator::RamSize / 4;
+    size_t payload_words = 0;
+
     for (;;) {
-        const uint32_t entry = m_emulator->ReadWord(addr & 0x1ffffc);
-        uint8_t count = entry >> 24;
+        uint32_t entry = ram[(addr & 0x1ffffc) / 4];
 
-        while (count-- != 0) {
-            addr += 4;
+        /* ordering tables are mostly empty nodes, chase those without the gpu */
+        while ((entry >> 24) == 0 && (entry & 0x800000) == 0 && budget != 0) {
+            addr = entry & 0xffffff;
+            entry = ram[(addr & 0x1ffffc) / 4];
+            --budget;
+        }
 
-            const uint32_t data = m_emulator->ReadWord(addr & 0x1ffffc);
-            m_emulator->m_gpu->Gp0(data);
+        if (budget == 0) {
+            spdlog::warn("gpu dma linked list loop at 0x{:06x}", addr);
+            break;
+        }
+
+        const uint8_t count = entry >> 24;
+
+        if (count != 0) {
+            const uint32_t offset = (addr + 4) & 0x1ffffc;
+            const uint32_t *payload = &ram[offset / 4];
+
+            uint32_t wrapped[UINT8_MAX];
+
+            if (offset + 4 * count > Emulator::RamSize) {
+                for (size_t i = 0; i < count; ++i) {
+                    wrapped[i] = ram[((offset + 4 * i) & 0x1ffffc) / 4];
+                }
+
+                payload = wrapped;
+            }
+
+            m_emulator->m_gpu->Gp0Block(payload, count);
+            payload_words += count;
+
+            if (recorder) {
+                recorder->Dma(payload, count);
+            }
         }
 
         if ((entry & 0x800000) != 0) {
@@ -180,10 +446,14 @@ void Dmac::StartTransferGpu()
         }
 
         addr = entry & 0xffffff;
+        --budget;
     }
+
+    const size_t headers = Emulator::RamSize / 4 - budget + 1;
+    return headers + payload_words;
 }
 
-void Dmac::StartTransferCdrom()
+size_t Dmac::StartTransferCdrom()
 {
     const DmaChannel *channel = &m_channels[Channel::Cdrom];
 
@@ -198,20 +468,43 @@ void Dmac::StartTransferCdrom()
     uint32_t addr = channel->madr.address;
     size_t words = channel->bcr.size;
 
-    do {
-        const uint32_t data = m_emulator->m_cdc->ReadDma();
-        m_emulator->WriteWord(addr, data);
-        addr = (addr + (channel->chcr.backward ? -4 : 4)) & 0xffffff;
-    } while (--words != 0);
+    const size_t total = words;
+
+    if (channel->chcr.backward) {
+        do {
+            const uint32_t data = m_emulator->m_cdc->ReadDma();
+            m_emulator->WriteWord(addr, data);
+            addr = (addr - 4) & 0xffffff;
+        } while (--words != 0);
+
+        return total;
+    }
+
+    while (words != 0) {
+        const uint32_t offset = addr & 0x1ffffc;
+        const size_t span = std::min(words, (Emulator::RamSize - offset) / 4);
+
+        uint32_t *ram = reinterpret_cast<uint32_t *>(&m_emulator->m_ram[offset]);
+
+        m_emulator->m_cdc->ReadDmaBlock(ram, span);
+        m_emulator->RamWritten(offset, 4 * span);
+
+        addr += 4 * span;
+        words -= span;
+    }
+
+    return total;
 }
 
-void Dmac::StartTransferSpu()
+size_t Dmac::StartTransferSpu()
 {
     const DmaChannel *channel = &m_channels[Channel::Spu];
 
     uint32_t addr = channel->madr.address;
     size_t words = channel->bcr.size * channel->bcr.count;
 
+    const size_t total = words;
+
     if (channel->chcr.direction != Direction::FromRam) {
         Error("unimplemented spu dma direction");
     }
@@ -220,31 +513,82 @@ void Dmac::StartTransferSpu()
         Error("unimplemented spu dma sync mode");
     }
 
-    do {
-        const uint32_t data = m_emulator->ReadWord(addr & 0x1ffffc);
-        m_emulator->m_spu->WriteDma(data);
+    if (channel->chcr.backward) {
+        do {
+            const uint32_t data = m_emulator->ReadWord(addr & 0x1ffffc);
+            m_emulator->m_spu->WriteDma(data);
+
+            addr -= 4;
+        } while (--words != 0);
+
+        return total;
+    }
+
+    while (words != 0) {
+        const uint32_t offset = addr & 0x1ffffc;
+        const size_t span = std::min(words, (Emulator::RamSize - offset) / 4);
+
+        const uint32_t *ram = reinterpret_cast<const uint32_t *>(&m_emulator->m_ram[offset]);
+        m_emulator->m_spu->WriteDmaBlock(ram, span);
 
-        addr += channel->chcr.backward ? -4 : 4;
-    } while (--words != 0);
+        addr += 4 * span;
+        words -= span;
+    }
+
+    return total;
 }
 
-void Dmac::StartTransferOtc()
+size_t Dmac::StartTransferOtc()
 {
     const DmaChannel *channel = &m_channels[Channel::Otc];
 
     uint32_t addr = channel->madr.address;
     size_t words = channel->bcr.size;
 
-    do {
-        if (words == 1) {
-            m_emulator->WriteWord(addr, 0xffffff);
-            continue;
-        }
+    const size_t total = words;
+
+    const uint32_t top = addr & 0x1ffffc;
+    const uint32_t bottom = (addr - 4 * (words - 1)) & 0xffffff;
+
+    /* tables that wrap below the start of ram are rare enough to build slowly */
+    if (4 * (words - 1) > top) {
+        do {
+            if (words == 1) {
+                m_emulator->WriteWord(addr, 0xffffff);
+                continue;
+            }
+
+            m_emulator->WriteWord(addr, addr - 4);
+            addr = (addr - 4) & 0xffffff;
+        } while (--words != 0);
 
-        m_emulator->WriteWord(addr, addr - 4);
-        addr = (addr - 4) & 0xffffff;
-    } while (--words != 0);
-} 
+        return total;
+    }
+
+    /* each entry links to the one below it, and the lowest ends the list */
+    uint32_t *table = reinterpret_cast<uint32_t *>(&m_emulator->m_ram[bottom & 0x1ffffc]);
+    table[0] = 0xffffff;
+
+    size_t i = 1;
+
+#if defined(__SSE2__)
+    const __m128i step = _mm_set1_epi32(16);
+    __m128i links = _mm_setr_epi32(bottom, bottom + 4, bottom + 8, bottom + 12);
+
+    for (; i + 4 <= words; i += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&table[i]), links);
+        links = _mm_add_epi32(links, step);
+    }
+#endif
+
+    for (; i < words; ++i) {
+        table[i] = bottom + 4 * (i - 1);
+    }
+
+    m_emulator->RamWritten(bottom & 0x1ffffc, 4 * words);
+
+    return total;
+}
 
 void Dmac::UpdateInterrupts()
 {
@@ -1,9 +1,11 @@
 #ifndef CORE_DMAC_HPP
 #define CORE_DMAC_HPP
 
+#include <cstddef>
 #include <cstdint>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
 
 namespace Core
 {
@@ -12,21 +14,37 @@ class Emulator;
 
 class Dmac {
 public:
+    enum Channel { MdecIn, MdecOut, Gpu, Cdrom, Spu, Pio, Otc, Count };
+
     Dmac(Emulator *emulator);
 
     void Reset();
+    void DoState(Serializer& s);
 
     uint32_t Read(uint32_t addr);
     void Write(uint32_t addr, uint32_t data);
 
+    /* a device has data for a channel that was enabled before it was ready */
+    void Request(Channel index);
+
 private:
-    enum Channel { MdecIn, MdecOut, Gpu, Cdrom, Spu, Pio, Otc, Count };
+    void StartTransfer(Channel index);
+    void FinishTransfer(Channel index);
+    void FlushTransfer(Channel index);
+
+    /* output is collected as the transfer finishes, leaving the decoder to run */
+    void StartTransferMdecOut();
+    void FinishTransferMdecOut();
+
+    /* each returns the number of words that crossed the bus */
+    size_t StartTransferMdecIn();
+    size_t StartTransferGpu();
+    size_t StartTransferCdrom();
+    size_t StartTransferSpu();
+    size_t StartTransferOtc();
 
-    void StartTransferMdecIn();
-    void StartTransferGpu();
-    void StartTransferCdrom();
-    void StartTransferSpu();
-    void StartTransferOtc();
+    /* approximate bus cycles per word, indexed by channel */
+    static constexpr int64_t WordCycles[Channel::Count] = { 1, 1, 1, 24, 4, 1, 1 };
 
     void UpdateInterrupts();
 
@@ -52,7 +70,10 @@ private:
 
             BitField<uint32_t, Direction, 0, 1> direction;
             BitField<uint32_t, bool, 1, 1> backward;
+            BitField<uint32_t, bool, 8, 1> chopping;
             BitField<uint32_t, SyncMode, 9, 2> sync_mode;
+            BitField<uint32_t, uint32_t, 16, 3> dma_window;
+            BitField<uint32_t, uint32_t, 20, 3> cpu_window;
             BitField<uint32_t, bool, 24, 1> enable;
             BitField<uint32_t, bool, 28, 1> start;
         } chcr;
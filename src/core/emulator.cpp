@@ -14,8 +14,10 @@
 #include "emulator.hpp"
 #include "error.hpp"
 #include "gpu.hpp"
+#include "gpu_recorder.hpp"
 #include "intc.hpp"
 #include "io.hpp"
+#include "mdec.hpp"
 #include "scheduler.hpp"
 #include "spu.hpp"
 #include "timer.hpp"
@@ -25,16 +27,18 @@ namespace Core
 
 Emulator::Emulator(const std::filesystem::path& bios,
                    const std::filesystem::path& disc,
-                   bool enable_audio)
+                   bool enable_audio,
+                   DiscAccess disc_access)
     : m_cpu(std::make_unique<Cpu::Core>(this)),
-      m_cdc(std::make_unique<Cdc>(this, disc)),
+      m_cdc(std::make_unique<Cdc>(this, disc, disc_access)),
       m_gpu(std::make_unique<Gpu>()),
       m_intc(std::make_unique<Intc>(this)),
       m_scheduler(std::make_unique<Scheduler>()),
-      m_spu(std::make_unique<Spu>(enable_audio)),
+      m_spu(std::make_unique<Spu>(this, enable_audio)),
       m_joypad(new Digital()),
       m_dmac(std::make_unique<Dmac>(this)),
       m_io(std::make_unique<Io>(this, m_joypad)),
+      m_mdec(std::make_unique<Mdec>(this)),
       m_timer0(Timer<0>(this)),
       m_timer1(Timer<1>(this)),
       m_timer2(Timer<2>(this))
@@ -59,14 +63,19 @@ Emulator::Emulator(const std::filesystem::path& bios,
     m_bios[0x6f17] = 0xaf;
 
     auto vblank_cb = [=]() {
-        std::memcpy(m_swapchain.ProducerBuffer(), m_gpu->Framebuffer(), 2 * 1024 * 512);
+        if (m_gpu_recorder) {
+            m_gpu_recorder->Vblank();
+        }
+
+        m_gpu->Vblank();
+        m_gpu->ExportFrame(m_swapchain.ProducerBuffer());
         m_swapchain.Swap();
 
         m_intc->AssertInterrupt(Interrupt::Vblank);
         m_frame_finished = true;
     };
 
-    auto spu_cb = [=]() { m_spu->Tick(); };
+    auto spu_cb = [=]() { m_spu->Sync(); };
 
     m_scheduler->AddEvent(
         Scheduler::Event::Type::Vblank,
@@ -78,7 +87,7 @@ Emulator::Emulator(const std::filesystem::path& bios,
     m_scheduler->AddEvent(
         Scheduler::Event::Type::Spu,
         Scheduler::Event::Mode::Periodic,
-        CpuFrequency / 44100,
+        Spu::BatchSamples * Spu::SampleCycles,
         spu_cb
     );
 
@@ -99,6 +108,7 @@ void Emulator::Reset()
     m_spu->Reset();
     m_dmac->Reset();
     m_io->Reset();
+    m_mdec->Reset();
     m_timer0.Reset();
     m_timer1.Reset();
     m_timer2.Reset();
@@ -106,29 +116,16 @@ void Emulator::Reset()
 
 void Emulator::Run()
 {
-    for (size_t i = 0; i < CyclesPerFrame / 2; ++i) {
-        m_cpu->Run();
-
-        m_cdc->Tick(); // DONE
-        m_cdc->Tick();
-
-        m_spu->Tick(); // DONE
-        m_spu->Tick();
-
-        m_timer0.Tick(); // TODO
-        m_timer0.Tick();
+    m_frame_finished = false;
 
-        m_timer1.Tick(); // TODO
-        m_timer1.Tick();
+    /* the interpreter charges its own fetch cycles to the scheduler */
+    while (!m_frame_finished) {
+        while (m_scheduler->NextEventTarget() > 0) {
+            m_cpu->Run();
+        }
 
-        m_timer2.Tick(); // TODO
-        m_timer2.Tick();
+        m_scheduler->UpdateEvents();
     }
-
-    m_intc->AssertInterrupt(Interrupt::Vblank); // DONE
-
-    std::memcpy(m_swapchain.ProducerBuffer(), m_gpu->Framebuffer(), 2 * 1024 * 512);
-    m_swapchain.Swap();
 }
 
 void Emulator::BenchFrame()
@@ -224,6 +221,44 @@ void Emulator::LoadExe(const std::filesystem::path& filepath)
     exe.read(reinterpret_cast<char *>(&m_ram[text]), header.text_size);
     exe.read(reinterpret_cast<char *>(&m_ram[data]), header.data_size);
     std::memset(&m_ram[bss], 0, header.bss_size);
+
+    RamWritten(text, header.text_size);
+    RamWritten(data, header.data_size);
+    RamWritten(bss, header.bss_size);
+}
+
+void Emulator::DoState(Serializer& s)
+{
+    /* the clock first, since the components re-arm their events against it */
+    m_scheduler->DoState(s);
+
+    m_scheduler->DoEvent(s, Scheduler::Event::Type::Vblank);
+    m_scheduler->DoEvent(s, Scheduler::Event::Type::Spu);
+
+    s.Do(m_scratchpad);
+    s.Do(m_frame_finished);
+
+    m_cpu->DoState(s);
+    m_cdc->DoState(s);
+    m_gpu->DoState(s);
+    m_intc->DoState(s);
+    m_spu->DoState(s);
+    m_dmac->DoState(s);
+    m_io->DoState(s);
+    m_mdec->DoState(s);
+    m_timer0.DoState(s);
+    m_timer1.DoState(s);
+    m_timer2.DoState(s);
+}
+
+void Emulator::StartGpuCapture(const std::filesystem::path& filepath)
+{
+    m_gpu_recorder = std::make_unique<GpuRecorder>(filepath, *m_gpu);
+}
+
+void Emulator::StopGpuCapture()
+{
+    m_gpu_recorder.reset();
 }
 
 void Emulator::BurstFill(void *dst, u32 addr, std::size_t size)
@@ -432,6 +467,11 @@ uint32_t Emulator::ReadWord(uint32_t addr)
 
     if (addr == 0x1f801810) {
         Tick(3);
+
+        if (m_gpu_recorder) {
+            m_gpu_recorder->Read(1);
+        }
+
         return m_gpu->GpuRead();
     }
 
@@ -440,10 +480,9 @@ uint32_t Emulator::ReadWord(uint32_t addr)
         return m_gpu->GpuStat();
     }
 
-    if (addr == 0x1f801824) {
+    if (addr == 0x1f801820 || addr == 0x1f801824) {
         Tick(3);
-        spdlog::warn("read from unimplemented mdec control reg");
-        return 0;
+        return m_mdec->Read(addr);
     }
 
     Error("read (word) from unknown address 0x{:08x}", addr);
@@ -453,7 +492,8 @@ void Emulator::WriteByte(uint32_t addr, uint8_t data)
 {
     if (addr < RamEnd) {
         m_ram[addr] = data;
-        Cpu::Recompiler::InvalidateAddress(addr);
+        m_cpu->InvalidateCode(addr);
+        m_ram_dirty.Mark(addr);
         return;
     }
 
@@ -499,7 +539,8 @@ void Emulator::WriteHalf(uint32_t addr, uint16_t data)
 {
     if (addr < RamEnd) {
         reinterpret_cast<uint16_t *>(m_ram.data())[addr >> 1] = data;
-        Cpu::Recompiler::InvalidateAddress(addr);
+        m_cpu->InvalidateCode(addr);
+        m_ram_dirty.Mark(addr);
         return;
     }
 
@@ -561,7 +602,8 @@ void Emulator::WriteWord(uint32_t addr, uint32_t data)
 {
     if (addr < RamEnd) {
         reinterpret_cast<uint32_t *>(m_ram.data())[addr >> 2] = data;
-        Cpu::Recompiler::InvalidateAddress(addr);
+        m_cpu->InvalidateCode(addr);
+        m_ram_dirty.Mark(addr);
         return;
     }
 
@@ -610,22 +652,35 @@ void Emulator::WriteWord(uint32_t addr, uint32_t data)
     }
 
     if (addr == 0x1f801810) {
+        if (m_gpu_recorder) {
+            m_gpu_recorder->Gp0(data);
+        }
+
         m_gpu->Gp0(data);
         return;
     }
 
     if (addr == 0x1f801814) {
-        m_gpu->Gp1(data);
-        return;
-    }
+        if (m_gpu_recorder) {
+            m_gpu_recorder->Gp1(data);
+        }
+
+        /* a reset or display mode change can move timer 0's dot clock */
+        const uint8_t command = data >> 24;
 
-    if (addr == 0x1f801820) {
-        spdlog::warn("write to unimplemented mdec command reg");
+        if (command == 0x00 || command == 0x08) {
+            m_timer0.Sync();
+            m_gpu->Gp1(data);
+            m_timer0.ScheduleInterrupt();
+            return;
+        }
+
+        m_gpu->Gp1(data);
         return;
     }
 
-    if (addr == 0x1f801824) {
-        spdlog::warn("write to unimplemented mdec control reg");
+    if (addr == 0x1f801820 || addr == 0x1f801824) {
+        m_mdec->Write(addr, data);
         return;
     }
 
@@ -6,9 +6,13 @@
 #include <memory>
 #include <string>
 
+#include <common/dirty_pages.hpp>
+#include <common/serializer.hpp>
 #include <common/swapchain.hpp>
 
 #include "cpu/core.hpp"
+#include "disc/disc.hpp"
+#include "frame.hpp"
 #include "scheduler.hpp"
 #include "timer.hpp"
 
@@ -18,18 +22,24 @@ namespace Core
 class Cdc;
 class Dmac;
 class Gpu;
+class GpuRecorder;
 class Intc;
 class Io;
 class Joypad;
+class Mdec;
 class Spu;
 
 class Emulator : public Cpu::Bus {
 public:
     Emulator(const std::filesystem::path& bios,
              const std::filesystem::path& disc,
-             bool enable_audio);
+             bool enable_audio,
+             DiscAccess disc_access = DiscAccess::ReadAhead);
     ~Emulator();
 
+    static constexpr std::size_t CpuFrequency = 44100 * 768;
+    static constexpr std::size_t CyclesPerFrame = CpuFrequency / 60;
+
     void Reset();
     void Run();
     void RunFrame();
@@ -37,6 +47,12 @@ public:
 
     void LoadExe(const std::filesystem::path& filepath);
 
+    /* every register and queue in the machine; the large memories are saved by pages */
+    void DoState(Serializer& s);
+
+    void StartGpuCapture(const std::filesystem::path& filepath);
+    void StopGpuCapture();
+
     inline void Tick(int64_t ticks) override { m_scheduler->Tick(ticks); }
 
     void BurstFill(void *dst, u32 addr, std::size_t size);
@@ -58,11 +74,17 @@ public:
     std::unique_ptr<Scheduler> m_scheduler;
     std::unique_ptr<Spu> m_spu;
 
+    std::unique_ptr<GpuRecorder> m_gpu_recorder;
+
     Joypad *m_joypad;
 
-    Swapchain<2, uint8_t[2 * 1024 * 512]> m_swapchain;
+    Swapchain<3, Frame> m_swapchain;
 
 private:
+    friend class Dmac;
+    friend class Mdec;
+    friend class SaveStates;
+
     static constexpr uint32_t BiosStart = 0x1fc00000;
     static constexpr uint32_t BiosEnd = 0x1fc80000;
     static constexpr size_t BiosSize = 512 * 1024;
@@ -74,15 +96,22 @@ private:
     static constexpr uint32_t ScratchpadEnd = 0x1f800400;
     static constexpr size_t ScratchpadSize = 0x400;
 
-    static constexpr std::size_t CpuFrequency = 44100 * 768;
-    static constexpr std::size_t CyclesPerFrame = CpuFrequency / 60;
-
     std::array<uint8_t, BiosSize> m_bios;
     std::array<uint8_t, RamSize> m_ram;
     std::array<uint8_t, ScratchpadSize> m_scratchpad;
 
+    DirtyPages<RamSize> m_ram_dirty;
+
+    /* ram changed without passing through the cpu's stores */
+    inline void RamWritten(uint32_t offset, std::size_t size)
+    {
+        m_cpu->InvalidateCode(offset, size);
+        m_ram_dirty.Mark(offset, size);
+    }
+
     std::unique_ptr<Dmac> m_dmac;
     std::unique_ptr<Io> m_io;
+    std::unique_ptr<Mdec> m_mdec;
 
     Timer<0> m_timer0;
     Timer<1> m_timer1;
@@ -0,0 +1,22 @@
+#ifndef CORE_FRAME_HPP
+#define CORE_FRAME_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace Core
+{
+
+/* The displayed image as RGBA8, packed with a stride of width pixels */
+struct Frame {
+    static constexpr size_t MaxWidth = 640;
+    static constexpr size_t MaxHeight = 512;
+
+    size_t width, height;
+    std::array<uint32_t, MaxWidth * MaxHeight> pixels;
+};
+
+}
+
+#endif /* CORE_FRAME_HPP */
@@ -1,4 +1,11 @@
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include <spdlog/spdlog.h>
 
@@ -23,6 +30,7 @@ void Gpu::Reset()
     m_drawing_offset.raw = 0;
     m_mask_bit.raw = 0;
     m_display_enable = false;
+    m_display_field = Field::Even;
     m_dma_mode = DmaMode::Off;
     m_display_area_origin.raw = 0;
     m_horizontal_display_range.start = 512;
@@ -34,57 +42,142 @@ void Gpu::Reset()
     UpdateGpustat();
 }
 
+void Gpu::DoState(Serializer& s)
+{
+    s.Section("GPU ");
+
+    s.Do(m_gpuread);
+    s.Do(m_dma_mode);
+    s.Do(m_gpustat);
+    s.Do(m_texpage);
+    s.Do(m_texture_window);
+    s.Do(m_drawing_area_start);
+    s.Do(m_drawing_area_end);
+    s.Do(m_drawing_offset);
+    s.Do(m_mask_bit);
+
+    s.Do(m_display_enable);
+    s.Do(m_display_field);
+    s.Do(m_display_area_origin);
+    s.Do(m_horizontal_display_range);
+    s.Do(m_vertical_display_range);
+    s.Do(m_display_mode);
+
+    s.Do(m_receiving_parameters);
+    s.Do(m_parameters_remaining);
+    s.Do(m_transfer);
+    s.Do(m_command_fifo_size);
+    s.Do(m_command_fifo);
+}
+
 uint32_t Gpu::GpuRead()
 {
     if (m_transfer.mode == TransferMode::Read) {
-        uint32_t data = 0;
+        uint16_t data[2] = { 0, 0 };
 
-        for (size_t i = 0; i < 2; ++i) {
-            const uint16_t d = ReadVram(m_transfer.x + m_transfer.tx,
-                                        m_transfer.y + m_transfer.ty);
-            data |= d << (16 * i);
+        TransferFromVram(data, 2);
+        return data[0] | (data[1] << 16);
+    }
 
-            if (++m_transfer.tx == m_transfer.w) {
-                m_transfer.tx = 0;
+    return m_gpuread;
+}
 
-               if (++m_transfer.ty == m_transfer.h) {
-                    m_transfer.ty = 0;
+uint32_t Gpu::GpuStat()
+{
+    /* progressive output flips bit 31 every scanline, which reads stand in for */
+    if (!m_display_mode.vertical_interlace) {
+        m_gpustat.raw ^= 0x80000000;
+    }
 
-                    m_transfer.mode = TransferMode::Fifo;
-                }
-            }
-        }
+    return m_gpustat.raw;
+}
 
-        return data;
+void Gpu::Vblank()
+{
+    if (m_display_mode.vertical_interlace) {
+        m_display_field = (m_display_field == Field::Even) ? Field::Odd : Field::Even;
+    } else {
+        m_display_field = Field::Even;
     }
 
-    return m_gpuread;
+    /* interlaced output reports the field being shown in bit 31, and bit 13 with it */
+    m_gpustat.interlace_field2 = m_display_field;
+    UpdateGpustat();
 }
 
-uint32_t Gpu::GpuStat()
+int64_t Gpu::DotClockDivider() const
 {
-    m_gpustat.raw ^= 0x80000000;
-    return m_gpustat.raw;
+    static constexpr int64_t Dividers[] = { 10, 8, 5, 4 };
+
+    if (m_display_mode.force_hres_368px) {
+        return 7;
+    }
+
+    return Dividers[static_cast<size_t>(m_display_mode.hres.GetValue())];
+}
+
+void Gpu::ExportFrame(Frame& frame) const
+{
+    static constexpr size_t Widths[] = { 256, 320, 512, 640 };
+
+    if (m_display_mode.force_hres_368px) {
+        frame.width = 368;
+    } else {
+        frame.width = Widths[static_cast<size_t>(m_display_mode.hres.GetValue())];
+    }
+
+    const size_t start = m_vertical_display_range.start;
+    const size_t end = m_vertical_display_range.end;
+
+    frame.height = (end > start) ? end - start : 0;
+    frame.height = std::min(frame.height, Frame::MaxHeight);
+
+    if (!m_display_enable) {
+        std::fill_n(frame.pixels.data(), frame.width * frame.height, 0xff000000);
+        return;
+    }
+
+    /* 480i shows one field per vblank, so only that field is converted */
+    size_t y = m_display_area_origin.y;
+    size_t ystep = 1;
+
+    if (m_display_mode.vres == VerticalResolution::V480
+        && m_display_mode.vertical_interlace) {
+        y += static_cast<size_t>(m_display_field);
+        ystep = 2;
+    }
+
+    const bool bgr888 = m_display_mode.pixel_format == PixelFormat::BGR888;
+
+    /* 24-bit rows are read as halfwords, plus one for a pixel straddling the end */
+    const size_t halfwords = bgr888 ? (3 * frame.width + 1) / 2 + 1 : frame.width;
+
+    std::array<uint16_t, VramWidth> row;
+
+    for (size_t i = 0; i < frame.height; ++i, y += ystep) {
+        ReadVramRow(m_display_area_origin.x, y & 0x1ff, row.data(),
+                    std::min(halfwords, VramWidth));
+
+        uint32_t *output = &frame.pixels[frame.width * i];
+
+        if (bgr888) {
+            ConvertRowBgr888(reinterpret_cast<const uint8_t *>(row.data()),
+                             output, frame.width);
+        } else {
+            ConvertRowXbgr1555(row.data(), output, frame.width);
+        }
+    }
 }
 
 void Gpu::Gp0(uint32_t data)
 {
     if (m_transfer.mode == TransferMode::Write) {
-        for(size_t i = 0; i < 2; ++i) {
-            WriteVram((m_transfer.x + m_transfer.tx) & 0x3ff,
-                      (m_transfer.y + m_transfer.ty) & 0x1ff,
-                      data >> (16 * i));
-
-            if (++m_transfer.tx == m_transfer.w) {
-                m_transfer.tx = 0;
-
-                if (++m_transfer.ty == m_transfer.h) {
-                    m_transfer.mode = TransferMode::Fifo;
-                    return;
-                }
-            }
-        }
+        const uint16_t halves[2] = {
+            static_cast<uint16_t>(data),
+            static_cast<uint16_t>(data >> 16)
+        };
 
+        TransferToVram(halves, 2);
         return;
     }
 
@@ -96,7 +189,8 @@ void Gpu::Gp0(uint32_t data)
         m_command_fifo[m_command_fifo_size++] = data;
 
         if (--m_parameters_remaining == 0) {
-            ExecuteCommand();
+            const Command& command = CommandTable[m_command_fifo[0] >> 24];
+            (this->*command.handler)(m_command_fifo.data());
 
             m_receiving_parameters = false;
             m_command_fifo_size = 0;
@@ -105,126 +199,68 @@ void Gpu::Gp0(uint32_t data)
         return;
     }
 
-    const uint8_t command = data >> 24;
-
-    switch (command) {
-    case 0x00:
-        if (data != 0) {
-            spdlog::debug("gp0(00h) junk 0x{:06x}", data);
-        }
-
-        break;
-    case 0x01:
-        /* TODO: texture cache */
-        break;
-    case 0x02:
-        m_command_fifo[m_command_fifo_size++] = data;
-
-        m_receiving_parameters = true;
-        m_parameters_remaining = 2;
-        break;
-    case 0x20:
-        m_command_fifo[m_command_fifo_size++] = data;
-
-        m_receiving_parameters = true;
-        m_parameters_remaining = 3;
-        break;
-    case 0x28:
-        m_command_fifo[m_command_fifo_size++] = data;
+    const Command& command = DecodeCommand(data);
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 4;
-        break;
-    case 0x2a:
-        m_command_fifo[m_command_fifo_size++] = data;
+    if (command.length == 1) {
+        (this->*command.handler)(&data);
+        return;
+    }
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 4;
-        break;
-    case 0x2c:
-        m_command_fifo[m_command_fifo_size++] = data;
+    m_command_fifo[m_command_fifo_size++] = data;
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 8;
-        break;
-    case 0x2d:
-        m_command_fifo[m_command_fifo_size++] = data;
+    m_receiving_parameters = true;
+    m_parameters_remaining = command.length - 1;
+}
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 8;
-        break;
-    case 0x30:
-        m_command_fifo[m_command_fifo_size++] = data;
+void Gpu::Gp0Block(const uint32_t *data, size_t words)
+{
+    while (words != 0) {
+        if (m_transfer.mode == TransferMode::Write) {
+            /* a trailing odd halfword pads out the final word of the transfer */
+            const size_t halfwords = TransferToVram(reinterpret_cast<const uint16_t *>(data),
+                                                    2 * words);
+            const size_t consumed = (halfwords + 1) / 2;
+
+            data += consumed;
+            words -= consumed;
+            continue;
+        }
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 5;
-        break;
-    case 0x38:
-        m_command_fifo[m_command_fifo_size++] = data;
+        /* packets that arrive whole are executed in place, skipping the fifo */
+        if (!m_receiving_parameters) {
+            const Command& command = DecodeCommand(*data);
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 7;
-        break;
-    case 0x60:
-    case 0x62:
-        m_command_fifo[m_command_fifo_size++] = data;
+            if (command.length <= words) {
+                (this->*command.handler)(data);
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 2;
-        break;
-    case 0x64: case 0x65:
-        m_command_fifo[m_command_fifo_size++] = data;
+                data += command.length;
+                words -= command.length;
+                continue;
+            }
+        }
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 3;
-        break;
-    case 0x68:
-        m_command_fifo[m_command_fifo_size++] = data;
+        Gp0(*data++);
+        --words;
+    }
+}
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 1;
-        break;
-    case 0x7c:
-        m_command_fifo[m_command_fifo_size++] = data;
+void Gpu::GpuReadBlock(uint32_t *data, size_t words)
+{
+    if (m_transfer.mode == TransferMode::Read) {
+        uint16_t *halves = reinterpret_cast<uint16_t *>(data);
+        const size_t halfwords = TransferFromVram(halves, 2 * words);
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 2;
-        break;
-    case 0x80:
-        m_command_fifo[m_command_fifo_size++] = data;
+        if ((halfwords & 1) != 0) {
+            halves[halfwords] = 0;
+        }
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 3;
-        break;
-    case 0xa0: 
-    case 0xc0:
-        m_command_fifo[m_command_fifo_size++] = data;
+        const size_t produced = (halfwords + 1) / 2;
 
-        m_receiving_parameters = true;
-        m_parameters_remaining = 2;
-        break;
-    case 0xe1:
-        m_texpage.raw = data & 0x3fff;
-        UpdateGpustat();
-        break;
-    case 0xe2:
-        m_texture_window.raw = data & 0xfffff;
-        break;
-    case 0xe3:
-        m_drawing_area_start.raw = data & 0x7ffff;
-        break;
-    case 0xe4:
-        m_drawing_area_end.raw = data & 0x7ffff;
-        break;
-    case 0xe5:
-        m_drawing_offset.raw = data & 0x3fffff;
-        break;
-    case 0xe6:
-        m_mask_bit.raw = data & 0x3;
-        UpdateGpustat();
-        break;
-    default: Error("unknown gp0 command 0x{:02x}", command);
+        data += produced;
+        words -= produced;
     }
+
+    std::fill_n(data, words, m_gpuread);
 }
 
 void Gpu::Gp1(uint32_t data)
@@ -289,163 +325,285 @@ void Gpu::Gp1(uint32_t data)
     }
 }
 
-#define POLY(n) case n: DrawPolygon<static_cast<Polygon>(n)>(); break;
+template <size_t Opcode>
+constexpr Gpu::Command Gpu::MakeCommand()
+{
+    if constexpr (Opcode == 0x00) {
+        return { 1, 0, &Gpu::CommandNop };
+    } else if constexpr (Opcode == 0x01) {
+        return { 1, 0, &Gpu::CommandClearCache };
+    } else if constexpr (Opcode == 0x02) {
+        return { 3, 0, &Gpu::CommandFill };
+    } else if constexpr (Opcode >= 0x20 && Opcode <= 0x3f) {
+        constexpr size_t vertices = (Opcode & Polygon::Quad) ? 4 : 3;
+        constexpr size_t textured = (Opcode & Polygon::Textured) ? 1 : 0;
+        constexpr size_t shaded = (Opcode & Polygon::Shaded) ? 1 : 0;
+
+        return { 1 + vertices * (1 + textured) + shaded * (vertices - 1), 0,
+                 &Gpu::DrawPolygon<Opcode> };
+    } else if constexpr (Opcode >= 0x60 && Opcode <= 0x7f) {
+        constexpr size_t textured = (Opcode & Polygon::Textured) ? 1 : 0;
+        constexpr size_t variable = (Opcode & 0x18) == 0 ? 1 : 0;
+
+        return { 2 + textured + variable, 0, &Gpu::DrawRectangle<Opcode & 0x1f> };
+    } else if constexpr (Opcode >= 0x80 && Opcode <= 0x9f) {
+        return { 4, 0, &Gpu::CommandCopyVram };
+    } else if constexpr (Opcode >= 0xa0 && Opcode <= 0xdf) {
+        return { 3, 0, &Gpu::CommandTransfer };
+    } else if constexpr (Opcode == 0xe1) {
+        return { 1, 0, &Gpu::CommandTexpage };
+    } else if constexpr (Opcode == 0xe2) {
+        return { 1, 0, &Gpu::CommandTextureWindow };
+    } else if constexpr (Opcode == 0xe3) {
+        return { 1, 0, &Gpu::CommandDrawingAreaStart };
+    } else if constexpr (Opcode == 0xe4) {
+        return { 1, 0, &Gpu::CommandDrawingAreaEnd };
+    } else if constexpr (Opcode == 0xe5) {
+        return { 1, 0, &Gpu::CommandDrawingOffset };
+    } else if constexpr (Opcode == 0xe6) {
+        return { 1, 0, &Gpu::CommandMaskBit };
+    } else {
+        return { 1, Invalid, nullptr };
+    }
+}
 
-void Gpu::ExecuteCommand()
+template <size_t... Opcodes>
+constexpr std::array<Gpu::Command, 256> Gpu::MakeCommandTable(std::index_sequence<Opcodes...>)
 {
-    const uint8_t command = m_command_fifo[0] >> 24;
+    return {{ MakeCommand<Opcodes>()... }};
+}
 
-    union {
-        uint16_t raw;
+const std::array<Gpu::Command, 256> Gpu::CommandTable =
+    Gpu::MakeCommandTable(std::make_index_sequence<256>());
 
-        BitField<uint16_t, uint8_t, 0, 5> r;
-        BitField<uint16_t, uint8_t, 5, 5> g;
-        BitField<uint16_t, uint8_t, 10, 5> b;
-        BitField<uint16_t, bool, 15, 1> a;
-    } c;
+const Gpu::Command& Gpu::DecodeCommand(uint32_t data) const
+{
+    const uint8_t opcode = data >> 24;
+    const Command& command = CommandTable[opcode];
 
-    c.raw = 0;
-    c.r = m_command_fifo[0] >> 3;
-    c.g = m_command_fifo[0] >> 11;
-    c.b = m_command_fifo[0] >> 19;
+    if ((command.flags & Invalid) != 0) {
+        Error("unknown gp0 command 0x{:02x}", opcode);
+    }
 
-    int16_t x = SignExtend<11>(m_command_fifo[1]);
-    int16_t y = SignExtend<11>(m_command_fifo[1] >> 16);
-    uint16_t w = m_command_fifo[2] & 0xffff;
-    uint16_t h = m_command_fifo[2] >> 16;
+    return command;
+}
 
-    uint8_t u, v;
+void Gpu::CommandNop(const uint32_t *packet)
+{
+    if (packet[0] != 0) {
+        spdlog::debug("gp0(00h) junk 0x{:06x}", packet[0]);
+    }
+}
 
-    uint16_t srcx, srcy, dstx, dsty;
+void Gpu::CommandClearCache(const uint32_t *packet)
+{
+    /* TODO: texture cache */
+    (void)packet;
+}
 
-    Clut clut;
+void Gpu::CommandFill(const uint32_t *packet)
+{
+    m_stats.fills++;
 
-    switch (command) {
-    case 0x02:
-        x &= 0x3f0;
-        y &= 0x1ff;
-        w = ((w & 0x3ff) + 0xf) & ~0xf;
-        h &= 0x1ff;
-
-        for (size_t ty = 0; ty < h; ++ty) {
-            for (size_t tx = 0; tx < w; ++tx) {
-                if (x >= m_drawing_area_start.x && x <= m_drawing_area_end.x
-                    && y >= m_drawing_area_start.y && y <= m_drawing_area_end.y) {
-                    WriteVram(x + tx, y + ty, c.raw);
-                }
+    Color16 c;
+    c.raw = 0;
+    c.r = packet[0] >> 3;
+    c.g = packet[0] >> 11;
+    c.b = packet[0] >> 19;
+
+    const int16_t x = packet[1] & 0x3f0;
+    const int16_t y = (packet[1] >> 16) & 0x1ff;
+    const uint16_t w = ((packet[2] & 0x3ff) + 0xf) & ~0xf;
+    const uint16_t h = (packet[2] >> 16) & 0x1ff;
+
+    for (size_t ty = 0; ty < h; ++ty) {
+        for (size_t tx = 0; tx < w; ++tx) {
+            if (x >= m_drawing_area_start.x && x <= m_drawing_area_end.x
+                && y >= m_drawing_area_start.y && y <= m_drawing_area_end.y) {
+                WriteVram(x + tx, y + ty, c.raw);
             }
         }
+    }
+}
 
-        break;
-    POLY(0x20);
-    POLY(0x28);
-    POLY(0x2a);
-    POLY(0x2c);
-    POLY(0x2d);
-    POLY(0x30);
-    POLY(0x38);
-    case 0x60:
-    case 0x62:
-        x += m_drawing_offset.x;
-        y += m_drawing_offset.y;
-
-        w = m_command_fifo[3] & 0xffff;
-        h = m_command_fifo[3] >> 16;
-
-        for (size_t ty = 0; ty < h; ++ty) {
-            for (size_t tx = 0; tx < w; ++tx) {
-                if (x >= m_drawing_area_start.x && x <= m_drawing_area_end.x
-                    && y >= m_drawing_area_start.y && y <= m_drawing_area_end.y) {
-                    WriteVram((x + tx) & 0x3ff, (y + ty) & 0x1ff, c.raw);
-                }
-            }
+void Gpu::CommandCopyVram(const uint32_t *packet)
+{
+    m_stats.copies++;
+
+    const uint16_t srcx = packet[1] & 0x3ff;
+    const uint16_t srcy = (packet[1] >> 16) & 0x1ff;
+    const uint16_t dstx = packet[2] & 0x3ff;
+    const uint16_t dsty = (packet[2] >> 16) & 0x1ff;
+    const uint16_t w = ((packet[3] - 1) & 0x3ff) + 1;
+    const uint16_t h = (((packet[3] >> 16) - 1) & 0x1ff) + 1;
+
+    for (size_t y = 0; y < h; ++y) {
+        const uint16_t *src = &m_vram[VramWidth * ((srcy + y) & 0x1ff)];
+        std::array<uint16_t, VramWidth> row;
+
+        /* wrapping rows are staged so they cannot alias the destination */
+        if (srcx + w <= VramWidth && dstx + w <= VramWidth) {
+            src += srcx;
+        } else {
+            ReadVramRow(srcx, (srcy + y) & 0x1ff, row.data(), w);
+            src = row.data();
         }
 
-        break;
-    case 0x64:
-    case 0x65:
-        x += m_drawing_offset.x;
-        y += m_drawing_offset.y;
-
-        u = m_command_fifo[2];
-        v = m_command_fifo[2] >> 8;
-
-        clut.x = (m_command_fifo[2] >> 12) & 0x3f0;
-        clut.y = (m_command_fifo[2] >> 22) & 0x1ff;
-
-        w = m_command_fifo[3] & 0xffff;
-        h = m_command_fifo[3] >> 16;
-
-        for (size_t ty = 0; ty < h; ++ty) {
-            for (size_t tx = 0; tx < w; ++tx) {
-                if (x >= m_drawing_area_start.x && x <= m_drawing_area_end.x
-                    && y >= m_drawing_area_start.y && y <= m_drawing_area_end.y) {
-                    WriteVram(x + tx, y + ty, FetchTexel(u + tx, v + ty, clut));
-                }
-            }
-        }
+        WriteVramRow(dstx, (dsty + y) & 0x1ff, src, w);
+    }
+}
 
-        break;
-    case 0x68:
-        x += m_drawing_offset.x;
-        y += m_drawing_offset.y;
-        WriteVram(x, y, c.raw);
-        break;
-    case 0x7c:
-        x += m_drawing_offset.x;
-        y += m_drawing_offset.y;
-
-        u = m_command_fifo[2];
-        v = m_command_fifo[2] >> 8;
-
-        clut.x = (m_command_fifo[2] >> 12) & 0x3f0;
-        clut.y = (m_command_fifo[2] >> 22) & 0x1ff;
-
-        for (size_t ty = 0; ty < 16; ++ty) {
-            for (size_t tx = 0; tx < 16; ++tx) {
-                if (x >= m_drawing_area_start.x && x <= m_drawing_area_end.x
-                    && y >= m_drawing_area_start.y && y <= m_drawing_area_end.y) {
-                    WriteVram(x + tx, y + ty, FetchTexel(u + tx, v + ty, clut));
-                }
+void Gpu::CommandTransfer(const uint32_t *packet)
+{
+    if (m_transfer.mode != TransferMode::Fifo) {
+        Error("gpu transfer overlap");
+    }
+
+    m_stats.transfers++;
+
+    const uint16_t w = packet[2] & 0xffff;
+    const uint16_t h = packet[2] >> 16;
+
+    m_transfer.mode = (packet[0] >> 29 == 0x5) ? TransferMode::Write : TransferMode::Read;
+    m_transfer.x = packet[1] & 1023;
+    m_transfer.y = (packet[1] >> 16) & 511;
+    m_transfer.w = ((w - 1) & 1023) + 1;
+    m_transfer.h = ((h - 1) & 511) + 1;
+    m_transfer.tx = 0;
+    m_transfer.ty = 0;
+}
+
+void Gpu::CommandTexpage(const uint32_t *packet)
+{
+    m_texpage.raw = packet[0] & 0x3fff;
+    UpdateGpustat();
+}
+
+void Gpu::CommandTextureWindow(const uint32_t *packet)
+{
+    m_texture_window.raw = packet[0] & 0xfffff;
+}
+
+void Gpu::CommandDrawingAreaStart(const uint32_t *packet)
+{
+    m_drawing_area_start.raw = packet[0] & 0x7ffff;
+}
+
+void Gpu::CommandDrawingAreaEnd(const uint32_t *packet)
+{
+    m_drawing_area_end.raw = packet[0] & 0x7ffff;
+}
+
+void Gpu::CommandDrawingOffset(const uint32_t *packet)
+{
+    m_drawing_offset.raw = packet[0] & 0x3fffff;
+}
+
+void Gpu::CommandMaskBit(const uint32_t *packet)
+{
+    m_mask_bit.raw = packet[0] & 0x3;
+    UpdateGpustat();
+}
+
+size_t Gpu::TransferToVram(const uint16_t *data, size_t count)
+{
+    size_t consumed = 0;
+
+    while (consumed < count) {
+        const size_t length = std::min(m_transfer.w - m_transfer.tx, count - consumed);
+
+        WriteVramRow((m_transfer.x + m_transfer.tx) & 0x3ff,
+                     (m_transfer.y + m_transfer.ty) & 0x1ff,
+                     &data[consumed], length);
+
+        consumed += length;
+        m_transfer.tx += length;
+
+        if (m_transfer.tx == m_transfer.w) {
+            m_transfer.tx = 0;
+
+            if (++m_transfer.ty == m_transfer.h) {
+                m_transfer.mode = TransferMode::Fifo;
+                break;
             }
         }
+    }
 
-        break;
-    case 0x80:
-        srcx = m_command_fifo[1];
-        srcy = m_command_fifo[1] >> 16;
-        dstx = m_command_fifo[2];
-        dsty = m_command_fifo[2] >> 16;
-        w = m_command_fifo[2];
-        h = m_command_fifo[2] >> 16;
-
-        for (size_t y = 0; y < h; ++y) {
-            for (size_t x = 0; x < w; ++x) {
-                WriteVram(dstx + x, dsty + y, ReadVram(srcx + x, srcy + y));
+    return consumed;
+}
+
+size_t Gpu::TransferFromVram(uint16_t *data, size_t count)
+{
+    size_t produced = 0;
+
+    while (produced < count) {
+        const size_t length = std::min(m_transfer.w - m_transfer.tx, count - produced);
+
+        ReadVramRow((m_transfer.x + m_transfer.tx) & 0x3ff,
+                    (m_transfer.y + m_transfer.ty) & 0x1ff,
+                    &data[produced], length);
+
+        produced += length;
+        m_transfer.tx += length;
+
+        if (m_transfer.tx == m_transfer.w) {
+            m_transfer.tx = 0;
+
+            if (++m_transfer.ty == m_transfer.h) {
+                m_transfer.ty = 0;
+                m_transfer.mode = TransferMode::Fifo;
+                break;
             }
         }
+    }
 
-        break;
-    case 0xa0:
-    case 0xc0:
-        if (m_transfer.mode != TransferMode::Fifo) {
-            Error("gpu transfer overlap");
-        }
+    return produced;
+}
 
-        m_transfer.mode = (command == 0xa0) ? TransferMode::Write : TransferMode::Read;
-        m_transfer.x = x & 1023;
-        m_transfer.y = y & 511;
-        m_transfer.w = ((w - 1) & 1023) + 1;
-        m_transfer.h = ((h - 1) & 511) + 1;
-        m_transfer.tx = 0;
-        m_transfer.ty = 0;
+void Gpu::WriteVramRow(size_t x, size_t y, const uint16_t *data, size_t count)
+{
+    assert(x < VramWidth);
+    assert(y < VramHeight);
+    assert(count <= VramWidth);
 
-        break;
-    default: Error("unknown gp0 command 0x{:02x}", command);
+    uint16_t *row = &m_vram[VramWidth * y];
+
+    if (!m_mask_bit.set && !m_mask_bit.check) {
+        const size_t length1 = std::min(count, VramWidth - x);
+        std::memmove(&row[x], data, sizeof(uint16_t) * length1);
+
+        const size_t length2 = count - length1;
+        std::memmove(row, &data[length1], sizeof(uint16_t) * length2);
+        return;
+    }
+
+    const uint16_t mask_set = m_mask_bit.set ? 0x8000 : 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t& pixel = row[(x + i) & 0x3ff];
+
+        if (m_mask_bit.check && (pixel & 0x8000) != 0) {
+            continue;
+        }
+
+        pixel = data[i] | mask_set;
     }
 }
 
-#undef POLY
+void Gpu::ReadVramRow(size_t x, size_t y, uint16_t *data, size_t count) const
+{
+    assert(x < VramWidth);
+    assert(y < VramHeight);
+    assert(count <= VramWidth);
+
+    const uint16_t *row = &m_vram[VramWidth * y];
+
+    const size_t length1 = std::min(count, VramWidth - x);
+    std::memcpy(data, &row[x], sizeof(uint16_t) * length1);
+
+    const size_t length2 = count - length1;
+    std::memcpy(&data[length1], row, sizeof(uint16_t) * length2);
+}
 
 void Gpu::UpdateGpustat()
 {
@@ -501,4 +659,103 @@ uint16_t Gpu::FetchTexel(uint8_t u, uint8_t v, Clut clut)
     }
 }
 
+void Gpu::FetchTexelRow(uint8_t u, uint8_t v, int step, Clut clut,
+                        size_t count, uint16_t *texels)
+{
+    const size_t xbase = 64 * m_texpage.texture_page_x;
+    const size_t ybase = 256 * m_texpage.texture_page_y;
+
+    const uint16_t *row = &m_vram[VramWidth * ((ybase + v) & 0x1ff)];
+    const uint16_t *palette = &m_vram[VramWidth * (clut.y & 0x1ff)];
+
+    switch (m_texpage.texture_format) {
+    case TextureFormat::I4:
+        for (size_t i = 0; i < count; ++i, u += step) {
+            const uint16_t index = row[(xbase + (u / 4)) & 0x3ff] >> (4 * (u & 0x3));
+            texels[i] = palette[(clut.x + (index & 0xf)) & 0x3ff];
+        }
+
+        break;
+    case TextureFormat::I8:
+        for (size_t i = 0; i < count; ++i, u += step) {
+            const uint16_t index = row[(xbase + (u / 2)) & 0x3ff] >> (8 * (u & 0x1));
+            texels[i] = palette[(clut.x + (index & 0xff)) & 0x3ff];
+        }
+
+        break;
+    case TextureFormat::ABGR1555:
+        for (size_t i = 0; i < count; ++i, u += step) {
+            texels[i] = row[(xbase + u) & 0x3ff];
+        }
+
+        break;
+    default: Error("unimplemented texture format");
+    }
+}
+
+static inline uint32_t Xbgr1555ToRgba8(uint16_t pixel)
+{
+    const uint32_t r = pixel & 0x1f;
+    const uint32_t g = (pixel >> 5) & 0x1f;
+    const uint32_t b = (pixel >> 10) & 0x1f;
+
+    return 0xff000000 | (((b << 3) | (b >> 2)) << 16)
+                      | (((g << 3) | (g >> 2)) << 8)
+                      | ((r << 3) | (r >> 2));
+}
+
+#if defined(__SSE2__)
+
+static inline __m128i Xbgr1555ToRgba8(__m128i pixels)
+{
+    const __m128i mask = _mm_set1_epi32(0x1f);
+
+    __m128i r = _mm_and_si128(pixels, mask);
+    __m128i g = _mm_and_si128(_mm_srli_epi32(pixels, 5), mask);
+    __m128i b = _mm_and_si128(_mm_srli_epi32(pixels, 10), mask);
+
+    r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+    g = _mm_or_si128(_mm_slli_epi32(g, 3), _mm_srli_epi32(g, 2));
+    b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+
+    __m128i rgba = _mm_set1_epi32(0xff000000);
+    rgba = _mm_or_si128(rgba, r);
+    rgba = _mm_or_si128(rgba, _mm_slli_epi32(g, 8));
+    rgba = _mm_or_si128(rgba, _mm_slli_epi32(b, 16));
+
+    return rgba;
+}
+
+#endif
+
+void Gpu::ConvertRowXbgr1555(const uint16_t *input, uint32_t *output, size_t count)
+{
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 8 <= count; i += 8) {
+        const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&input[i]));
+
+        const __m128i lo = Xbgr1555ToRgba8(_mm_unpacklo_epi16(pixels, zero));
+        const __m128i hi = Xbgr1555ToRgba8(_mm_unpackhi_epi16(pixels, zero));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&output[i]), lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&output[i + 4]), hi);
+    }
+#endif
+
+    for (; i < count; ++i) {
+        output[i] = Xbgr1555ToRgba8(input[i]);
+    }
+}
+
+void Gpu::ConvertRowBgr888(const uint8_t *input, uint32_t *output, size_t count)
+{
+    for (size_t i = 0; i < count; ++i, input += 3) {
+        output[i] = 0xff000000 | (input[2] << 16) | (input[1] << 8) | input[0];
+    }
+}
+
 }
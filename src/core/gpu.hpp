@@ -10,6 +10,9 @@
 
 #include <common/bit.hpp>
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
+
+#include "frame.hpp"
 
 namespace Core
 {
@@ -20,7 +23,17 @@ public:
 
     void Reset();
 
+    /* registers and transfer state; vram is left to the caller */
+    void DoState(Serializer& s);
+
     inline const void * Framebuffer() const { return m_vram.data(); };
+    inline uint16_t * Vram() { return m_vram.data(); }
+
+    void Vblank();
+    void ExportFrame(Frame& frame) const;
+
+    /* video clock cycles per pixel at the current horizontal resolution */
+    int64_t DotClockDivider() const;
 
     uint32_t GpuRead();
     uint32_t GpuStat();
@@ -28,8 +41,60 @@ public:
     void Gp0(uint32_t data);
     void Gp1(uint32_t data);
 
+    void Gp0Block(const uint32_t *data, size_t words);
+    void GpuReadBlock(uint32_t *data, size_t words);
+
+    struct Statistics {
+        size_t polygons, rectangles, fills, copies, transfers;
+    };
+
+    inline const Statistics& Stats() const { return m_stats; }
+    inline void ResetStats() { m_stats = {}; }
+
 private:
-    void ExecuteCommand();
+    using CommandHandler = void (Gpu::*)(const uint32_t *packet);
+
+    enum CommandFlags : uint8_t {
+        Invalid = 0x1
+    };
+
+    /* per-opcode gp0 packet layout; length counts the command word */
+    struct Command {
+        uint8_t length;
+        uint8_t flags;
+        CommandHandler handler;
+    };
+
+    template <size_t Opcode>
+    static constexpr Command MakeCommand();
+
+    template <size_t... Opcodes>
+    static constexpr std::array<Command, 256> MakeCommandTable(std::index_sequence<Opcodes...>);
+
+    static const std::array<Command, 256> CommandTable;
+
+    const Command& DecodeCommand(uint32_t data) const;
+
+    void CommandNop(const uint32_t *packet);
+    void CommandClearCache(const uint32_t *packet);
+    void CommandFill(const uint32_t *packet);
+    void CommandCopyVram(const uint32_t *packet);
+    void CommandTransfer(const uint32_t *packet);
+    void CommandTexpage(const uint32_t *packet);
+    void CommandTextureWindow(const uint32_t *packet);
+    void CommandDrawingAreaStart(const uint32_t *packet);
+    void CommandDrawingAreaEnd(const uint32_t *packet);
+    void CommandDrawingOffset(const uint32_t *packet);
+    void CommandMaskBit(const uint32_t *packet);
+
+    size_t TransferToVram(const uint16_t *data, size_t count);
+    size_t TransferFromVram(uint16_t *data, size_t count);
+
+    void WriteVramRow(size_t x, size_t y, const uint16_t *data, size_t count);
+    void ReadVramRow(size_t x, size_t y, uint16_t *data, size_t count) const;
+
+    static void ConvertRowXbgr1555(const uint16_t *input, uint32_t *output, size_t count);
+    static void ConvertRowBgr888(const uint8_t *input, uint32_t *output, size_t count);
 
     void UpdateGpustat();
 
@@ -72,6 +137,8 @@ private:
     };
 
     uint16_t FetchTexel(uint8_t u, uint8_t v, Clut clut);
+    void FetchTexelRow(uint8_t u, uint8_t v, int step, Clut clut,
+                       size_t count, uint16_t *texels);
 
     enum Polygon {
         None = 0,
@@ -82,6 +149,9 @@ private:
         Shaded = 0x10
     };
 
+    /* bits 3-4 of a gp0(60h-7fh) opcode */
+    enum class RectangleSize : uint8_t { Variable, Size1, Size8, Size16 };
+
     void DitherPixel(int32_t x, int32_t y, Color32& c) {
         static const int dither_table[4][4] = {
             { -4, +0, -3, +1 },
@@ -190,15 +260,17 @@ private:
     };
 
     template <size_t Settings>
-    void DrawPolygon()
+    void DrawPolygon(const uint32_t *packet)
     {
         constexpr size_t p = Settings & 0x1c;
 
+        m_stats.polygons++;
+
         struct Vertex vertices[4];
         Clut clut;
 
         if constexpr (p == Polygon::None) {
-            const struct F *f = reinterpret_cast<F *>(m_command_fifo.data());
+            const struct F *f = reinterpret_cast<const F *>(packet);
 
             for (size_t i = 0; i < 3; ++i) {
                 vertices[i].x = SignExtend<11>(f->xy[i]);
@@ -211,7 +283,7 @@ private:
         }
 
         if constexpr (p == Polygon::Textured) {
-            const struct T *t = reinterpret_cast<T *>(m_command_fifo.data());
+            const struct T *t = reinterpret_cast<const T *>(packet);
 
             for (size_t i = 0; i < 3; ++i) {
                 vertices[i].x = SignExtend<11>(t->xyuv[i].xy);
@@ -233,7 +305,7 @@ private:
         }
 
         if constexpr (p == Polygon::Shaded) {
-            const struct G *g = reinterpret_cast<G *>(m_command_fifo.data());
+            const struct G *g = reinterpret_cast<const G *>(packet);
 
             for (size_t i = 0; i < 3; ++i) {
                 vertices[i].x = SignExtend<11>(g->rgbxy[i].xy);
@@ -246,7 +318,7 @@ private:
         }
 
         if constexpr (p == (Polygon::Shaded | Polygon::Textured)) {
-            const struct GT *gt = reinterpret_cast<GT *>(m_command_fifo.data());
+            const struct GT *gt = reinterpret_cast<const GT *>(packet);
 
             for (size_t i = 0; i < 3; ++i) {
                 vertices[i].x = SignExtend<11>(gt->rgbxyuv[i].xy);
@@ -268,7 +340,7 @@ private:
         }
 
         if constexpr (p == Polygon::Quad) {
-            const struct F *f = reinterpret_cast<F *>(m_command_fifo.data());
+            const struct F *f = reinterpret_cast<const F *>(packet);
 
             for (size_t i = 0; i < 4; ++i) {
                 vertices[i].x = SignExtend<11>(f->xy[i]);
@@ -281,7 +353,7 @@ private:
         }
 
         if constexpr (p == (Polygon::Quad | Polygon::Textured)) {
-            const struct T *t = reinterpret_cast<T *>(m_command_fifo.data());
+            const struct T *t = reinterpret_cast<const T *>(packet);
 
             for (size_t i = 0; i < 4; ++i) {
                 vertices[i].x = SignExtend<11>(t->xyuv[i].xy);
@@ -303,7 +375,7 @@ private:
         }
 
         if constexpr (p == (Polygon::Quad | Polygon::Shaded)) {
-            const struct G *g = reinterpret_cast<G *>(m_command_fifo.data());
+            const struct G *g = reinterpret_cast<const G *>(packet);
 
             for (size_t i = 0; i < 4; ++i) {
                 vertices[i].x = SignExtend<11>(g->rgbxy[i].xy);
@@ -316,7 +388,7 @@ private:
         }
 
         if constexpr (p == (Polygon::Quad | Polygon::Shaded | Polygon::Textured)) {
-            const struct GT *gt = reinterpret_cast<GT *>(m_command_fifo.data());
+            const struct GT *gt = reinterpret_cast<const GT *>(packet);
 
             for (size_t i = 0; i < 4; ++i) {
                 vertices[i].x = SignExtend<11>(gt->rgbxyuv[i].xy);
@@ -621,6 +693,138 @@ private:
         } 
     }
 
+    template <size_t Settings>
+    void DrawRectangle(const uint32_t *packet)
+    {
+        constexpr bool textured = (Settings & Polygon::Textured) != 0;
+        constexpr bool raw_texture = (Settings & Polygon::RawTexture) != 0;
+        constexpr bool semi_transparent = (Settings & Polygon::SemiTransparent) != 0;
+        constexpr RectangleSize size = static_cast<RectangleSize>((Settings >> 3) & 0x3);
+
+        m_stats.rectangles++;
+
+        const uint32_t color = packet[0];
+
+        const int32_t x = static_cast<int16_t>(SignExtend<11>(packet[1]))
+                          + m_drawing_offset.x;
+        const int32_t y = static_cast<int16_t>(SignExtend<11>(packet[1] >> 16))
+                          + m_drawing_offset.y;
+
+        int32_t w, h;
+
+        if constexpr (size == RectangleSize::Variable) {
+            const uint32_t wh = packet[textured ? 3 : 2];
+
+            w = wh & 0x3ff;
+            h = (wh >> 16) & 0x1ff;
+        } else if constexpr (size == RectangleSize::Size1) {
+            w = h = 1;
+        } else if constexpr (size == RectangleSize::Size8) {
+            w = h = 8;
+        } else {
+            w = h = 16;
+        }
+
+        /* the drawing area is inclusive and always lies within vram */
+        const int32_t x0 = std::max<int32_t>(x, m_drawing_area_start.x);
+        const int32_t y0 = std::max<int32_t>(y, m_drawing_area_start.y);
+        const int32_t x1 = std::min<int32_t>(x + w - 1, m_drawing_area_end.x);
+        const int32_t y1 = std::min<int32_t>(y + h - 1, m_drawing_area_end.y);
+
+        if (x0 > x1 || y0 > y1) {
+            return;
+        }
+
+        const size_t count = x1 - x0 + 1;
+
+        const uint16_t mask_set = m_mask_bit.set ? 0x8000 : 0;
+        const bool mask_check = m_mask_bit.check;
+
+        if constexpr (!textured) {
+            Color16 c;
+            c.raw = 0;
+            c.r = color >> 3;
+            c.g = color >> 11;
+            c.b = color >> 19;
+
+            for (int32_t py = y0; py <= y1; ++py) {
+                uint16_t *row = &m_vram[VramWidth * py];
+
+                if (!semi_transparent && !mask_check) {
+                    std::fill_n(&row[x0], count, c.raw | mask_set);
+                    continue;
+                }
+
+                for (int32_t px = x0; px <= x1; ++px) {
+                    if (mask_check && (row[px] & 0x8000) != 0) {
+                        continue;
+                    }
+
+                    Color16 d = c;
+
+                    if constexpr (semi_transparent) {
+                        BlendPixel(px, py, d);
+                    }
+
+                    row[px] = d.raw | mask_set;
+                }
+            }
+
+            return;
+        }
+
+        const uint32_t texcoord = packet[2];
+
+        Clut clut;
+        clut.x = (texcoord >> 12) & 0x3f0;
+        clut.y = (texcoord >> 22) & 0x1ff;
+
+        const int ustep = m_texpage.textured_rect_xflip ? -1 : 1;
+        const int vstep = m_texpage.textured_rect_yflip ? -1 : 1;
+
+        const uint8_t u = (texcoord & 0xff) + ustep * (x0 - x);
+        uint8_t v = ((texcoord >> 8) & 0xff) + vstep * (y0 - y);
+
+        const int mr = color & 0xff;
+        const int mg = (color >> 8) & 0xff;
+        const int mb = (color >> 16) & 0xff;
+
+        std::array<uint16_t, VramWidth> texels;
+
+        for (int32_t py = y0; py <= y1; ++py, v += vstep) {
+            uint16_t *row = &m_vram[VramWidth * py];
+
+            FetchTexelRow(u, v, ustep, clut, count, texels.data());
+
+            for (int32_t px = x0; px <= x1; ++px) {
+                Color16 t;
+                t.raw = texels[px - x0];
+
+                if (t.raw == 0) {
+                    continue;
+                }
+
+                if (mask_check && (row[px] & 0x8000) != 0) {
+                    continue;
+                }
+
+                if constexpr (!raw_texture) {
+                    t.r = std::min((t.r * mr) >> 7, 31);
+                    t.g = std::min((t.g * mg) >> 7, 31);
+                    t.b = std::min((t.b * mb) >> 7, 31);
+                }
+
+                if constexpr (semi_transparent) {
+                    if (t.a) {
+                        BlendPixel(px, py, t);
+                    }
+                }
+
+                row[px] = t.raw | mask_set;
+            }
+        }
+    }
+
     static constexpr size_t CommandFifoSize = 16;
 
     static constexpr size_t VramWidth = 1024;
@@ -716,6 +920,7 @@ private:
     } m_mask_bit;
 
     bool m_display_enable;
+    Field m_display_field;
 
     union {
         uint32_t raw;
@@ -764,6 +969,8 @@ private:
     std::array<uint32_t, CommandFifoSize> m_command_fifo;
 
     std::array<uint16_t, VramWidth * VramHeight> m_vram;
+
+    Statistics m_stats = {};
 };
 
 }
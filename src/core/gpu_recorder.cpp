@@ -0,0 +1,85 @@
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include <common/serializer.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include "error.hpp"
+#include "gpu.hpp"
+#include "gpu_recorder.hpp"
+
+namespace Core
+{
+
+GpuRecorder::GpuRecorder(const std::filesystem::path& filepath, Gpu& gpu)
+{
+    m_capture.open(filepath, std::ios::binary | std::ios::trunc);
+
+    if (!m_capture.is_open()) {
+        Error("unable to open {}", filepath.filename().string());
+    }
+
+    Write(Magic, sizeof(Magic));
+    Write(&Version, sizeof(Version));
+
+    /* captures can start mid-game, so they begin with the current vram and registers */
+    WriteRecord(Record::Vram);
+    Write(gpu.Framebuffer(), 2 * 1024 * 512);
+
+    std::vector<uint8_t> state;
+    Serializer s(state);
+    gpu.DoState(s);
+
+    const uint32_t size = state.size();
+
+    WriteRecord(Record::State);
+    Write(&size, sizeof(size));
+    Write(state.data(), state.size());
+
+    spdlog::info("capturing gpu commands to {}", filepath.string());
+}
+
+GpuRecorder::~GpuRecorder()
+{
+    m_capture.close();
+}
+
+void GpuRecorder::Gp0(uint32_t data)
+{
+    WriteRecord(Record::Gp0);
+    Write(&data, sizeof(data));
+}
+
+void GpuRecorder::Gp1(uint32_t data)
+{
+    WriteRecord(Record::Gp1);
+    Write(&data, sizeof(data));
+}
+
+void GpuRecorder::Dma(const uint32_t *data, size_t count)
+{
+    const uint32_t words = count;
+
+    WriteRecord(Record::Dma);
+    Write(&words, sizeof(words));
+    Write(data, sizeof(uint32_t) * count);
+}
+
+void GpuRecorder::Read(size_t count)
+{
+    const uint32_t words = count;
+
+    WriteRecord(Record::Read);
+    Write(&words, sizeof(words));
+}
+
+void GpuRecorder::Vblank()
+{
+    WriteRecord(Record::Vblank);
+}
+
+}
@@ -0,0 +1,58 @@
+#ifndef CORE_GPU_RECORDER_HPP
+#define CORE_GPU_RECORDER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+
+namespace Core
+{
+
+class Gpu;
+
+/*
+ * Captures everything that reaches the gpu so it can be replayed without
+ * the cpu or bios. A capture is a header followed by a stream of records,
+ * each a type byte and its payload:
+ *
+ *   Gp0, Gp1  u32 data
+ *   Dma       u32 count, u32 data[count]
+ *   Read      u32 count (words read through GPUREAD)
+ *   Vblank    -
+ *   Vram      u16 vram[1024 * 512]
+ *   State     u32 size, u8 state[size] (Gpu::DoState)
+ */
+class GpuRecorder {
+public:
+    static constexpr char Magic[8] = { 'B', 'T', 'P', 'S', 'X', 'G', 'P', 'U' };
+    static constexpr uint32_t Version = 2;
+
+    enum class Record : uint8_t { Gp0, Gp1, Dma, Read, Vblank, Vram, State };
+
+    GpuRecorder(const std::filesystem::path& filepath, Gpu& gpu);
+    ~GpuRecorder();
+
+    void Gp0(uint32_t data);
+    void Gp1(uint32_t data);
+    void Dma(const uint32_t *data, size_t count);
+    void Read(size_t count);
+    void Vblank();
+
+private:
+    inline void Write(const void *data, size_t size)
+    {
+        m_capture.write(reinterpret_cast<const char *>(data), size);
+    }
+
+    inline void WriteRecord(Record record)
+    {
+        Write(&record, sizeof(record));
+    }
+
+    std::ofstream m_capture;
+};
+
+}
+
+#endif /* CORE_GPU_RECORDER_HPP */
@@ -3,6 +3,8 @@
 
 #include <cstdint>
 
+#include <common/serializer.hpp>
+
 namespace Core
 {
 
@@ -32,6 +34,16 @@ public:
         Update();
     }
 
+    inline void DoState(Serializer& s)
+    {
+        s.Do(m_status);
+        s.Do(m_mask);
+
+        if (s.Loading()) {
+            Update();
+        }
+    }
+
     inline void AssertInterrupt(Interrupt i)
     {
         m_status |= 1 << static_cast<uint32_t>(i);
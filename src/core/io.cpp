@@ -27,6 +27,23 @@ void Io::Reset()
     m_status.irq = false;
 }
 
+void Io::DoState(Serializer& s)
+{
+    s.Section("IO  ");
+
+    s.Do(m_baudrate);
+    s.Do(m_status);
+    s.Do(m_mode);
+    s.Do(m_control);
+    s.Do(m_rx_data);
+    s.Do(m_tx_data);
+    s.Do(m_tx_busy);
+
+    m_joypad->DoState(s);
+
+    m_emulator->m_scheduler->DoEvent(s, Scheduler::Event::Type::IoAcknowledge, [=]() { Acknowledge(); });
+}
+
 uint8_t Io::Rx()
 {
     const uint8_t data = m_rx_data;
@@ -41,29 +58,12 @@ void Io::Tx(uint8_t value)
 
     m_tx_data = value;
 
-    auto io_acknowledge_cb = [=]() { 
-        bool nack = true;
-
-        m_rx_data = m_joypad->Transmit(m_tx_data, nack);
-        m_status.tx_ready1 = true;
-        m_status.rx_has_data = true;
-        m_status.tx_ready2 = true;
-        m_status.nack = nack;
-
-        if (!nack && !m_status.irq) {
-            m_status.irq = true;
-            m_emulator->m_intc->AssertInterrupt(Interrupt::Controller);
-        }
-
-        m_tx_busy = false;
-    };
-
     m_emulator->m_scheduler->AddEvent(
         Scheduler::Event::Type::IoAcknowledge,
         Scheduler::Event::Mode::Once,
         /* TODO: ACK is pulled low some time after the transfer is complete */
         8 * (m_baudrate & ~1),
-        io_acknowledge_cb
+        [=]() { Acknowledge(); }
     );
 
     m_status.tx_ready1 = false;
@@ -72,6 +72,24 @@ void Io::Tx(uint8_t value)
     m_tx_busy = true;
 }
 
+void Io::Acknowledge()
+{
+    bool nack = true;
+
+    m_rx_data = m_joypad->Transmit(m_tx_data, nack);
+    m_status.tx_ready1 = true;
+    m_status.rx_has_data = true;
+    m_status.tx_ready2 = true;
+    m_status.nack = nack;
+
+    if (!nack && !m_status.irq) {
+        m_status.irq = true;
+        m_emulator->m_intc->AssertInterrupt(Interrupt::Controller);
+    }
+
+    m_tx_busy = false;
+}
+
 uint16_t Io::ReadStatus()
 {
     return m_status.raw;
@@ -4,6 +4,7 @@
 #include <cstdint>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
 
 #include "joypad/joypad.hpp"
 
@@ -17,6 +18,7 @@ public:
     Io(Emulator *emulator, Joypad *joypad);
 
     void Reset();
+    void DoState(Serializer& s);
 
     uint8_t Rx();
     void Tx(uint8_t value);
@@ -31,6 +33,8 @@ public:
     uint16_t m_baudrate;
 
 private:
+    void Acknowledge();
+
     union {
         uint32_t raw;
 
@@ -34,6 +34,12 @@ void Digital::SetKeystate(const Key& key, bool state)
     }
 }
 
+void Digital::DoState(Serializer& s)
+{
+    s.Do(m_command);
+    s.Do(m_state);
+}
+
 uint8_t Digital::Transmit(uint8_t value, bool& ack)
 {
     switch (m_state) {
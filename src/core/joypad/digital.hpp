@@ -17,6 +17,8 @@ public:
 
     void SetKeystate(const Key& key, bool state) override;
     uint8_t Transmit(uint8_t data, bool& ack) override;
+
+    void DoState(Serializer& s) override;
 private:
     static constexpr uint8_t ControllerId = 0x41;
 
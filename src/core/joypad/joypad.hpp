@@ -3,6 +3,8 @@
 
 #include <cstdint>
 
+#include <common/serializer.hpp>
+
 namespace Core
 {
 
@@ -29,6 +31,9 @@ public:
 
     virtual void SetKeystate(const Key& key, bool state) = 0;
     virtual uint8_t Transmit(uint8_t value, bool& ack) = 0;
+
+    /* the protocol state only, the keys belong to the host */
+    virtual void DoState(Serializer& s) = 0;
 };
 
 }
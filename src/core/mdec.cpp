@@ -0,0 +1,558 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <spdlog/spdlog.h>
+
+#include <common/signextend.hpp>
+
+#include "dmac.hpp"
+#include "emulator.hpp"
+#include "error.hpp"
+#include "mdec.hpp"
+
+namespace Core
+{
+
+/* raster position of each coefficient in stream order */
+static constexpr uint8_t ZigZag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10,
+    17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34,
+    27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36,
+    29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46,
+    53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* marks padding between blocks, and commonly the end of one */
+static constexpr uint16_t EndOfBlock = 0xfe00;
+
+Mdec::Mdec(Emulator *emulator) : m_emulator(emulator)
+{
+    m_stop = false;
+    m_busy = false;
+    m_produced = 0;
+
+    m_thread = std::thread(&Mdec::Run, this);
+}
+
+Mdec::~Mdec()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_request.notify_one();
+    m_thread.join();
+}
+
+void Mdec::Reset()
+{
+    WaitIdle();
+
+    m_command = 0;
+    m_remaining = 0;
+    m_params.clear();
+
+    m_data_in_enable = false;
+    m_data_out_enable = false;
+
+    m_depth = Depth4;
+    m_signed = false;
+    m_bit15 = false;
+
+    m_output.clear();
+    m_output_read = 0;
+    m_produced = 0;
+}
+
+void Mdec::DoState(Serializer& s)
+{
+    WaitIdle();
+
+    s.Section("MDEC");
+
+    s.Do(m_command);
+    s.Do(m_remaining);
+    s.Do(m_params);
+
+    s.Do(m_data_in_enable);
+    s.Do(m_data_out_enable);
+
+    s.Do(m_depth);
+    s.Do(m_signed);
+    s.Do(m_bit15);
+
+    s.Do(m_luma_quant);
+    s.Do(m_chroma_quant);
+    s.Do(m_scale);
+    s.Do(m_scale_pairs);
+
+    /* only output not yet collected is kept, and it is read from the start again */
+    if (!s.Loading()) {
+        m_output.erase(m_output.begin(), m_output.begin() + m_output_read);
+        m_output.resize(m_produced - m_output_read);
+
+        m_produced -= m_output_read;
+        m_output_read = 0;
+    }
+
+    s.Do(m_output);
+
+    m_output_read = 0;
+    m_produced = m_output.size();
+}
+
+uint32_t Mdec::Read(uint32_t addr)
+{
+    if (addr == 0x1f801820) {
+        uint32_t data;
+        ReadDmaBlock(&data, 1);
+        return data;
+    }
+
+    if (addr == 0x1f801824) {
+        const bool pending = OutputPending();
+
+        uint32_t status = 0;
+
+        status |= static_cast<uint32_t>(!pending) << 31;
+        status |= (m_remaining != 0 || pending) << 29;
+        status |= (m_data_in_enable && !pending) << 28;
+        status |= (m_data_out_enable && pending) << 27;
+        status |= ((m_command >> 25) & 0xf) << 23;
+
+        /* idle on the first luminance block */
+        status |= 4 << 16;
+        status |= (m_remaining - 1) & 0xffff;
+
+        return status;
+    }
+
+    Error("read from unknown mdec reg 0x{:08x}", addr);
+}
+
+void Mdec::Write(uint32_t addr, uint32_t data)
+{
+    if (addr == 0x1f801820) {
+        Push(&data, 1);
+        return;
+    }
+
+    if (addr == 0x1f801824) {
+        if (data & (1u << 31)) {
+            Reset();
+        }
+
+        m_data_in_enable = (data & (1 << 30)) != 0;
+        m_data_out_enable = (data & (1 << 29)) != 0;
+        return;
+    }
+
+    Error("write to unknown mdec reg 0x{:08x}", addr);
+}
+
+void Mdec::WriteDmaBlock(const uint32_t *data, size_t words)
+{
+    Push(data, words);
+}
+
+void Mdec::ReadDmaBlock(uint32_t *data, size_t words)
+{
+    WaitOutput(m_output_read + words);
+
+    size_t available;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        available = std::min(words, m_produced - m_output_read);
+    }
+
+    std::memcpy(data, m_output.data() + m_output_read, 4 * available);
+    std::fill_n(&data[available], words - available, 0);
+
+    m_output_read += available;
+}
+
+bool Mdec::OutputPending() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_busy || m_output_read < m_produced;
+}
+
+int64_t Mdec::OutputCycles(size_t words) const
+{
+    const int64_t macroblock = BlockCycles * BlocksPerMacroblock();
+    return macroblock * static_cast<int64_t>(words) / static_cast<int64_t>(WordsPerMacroblock());
+}
+
+void Mdec::Push(const uint32_t *data, size_t words)
+{
+    while (words != 0) {
+        if (m_remaining == 0) {
+            m_command = *data++;
+            --words;
+
+            switch (m_command >> 29) {
+            case 1: m_remaining = m_command & 0xffff; break;
+            case 2: m_remaining = (m_command & 1) ? 32 : 16; break;
+            case 3: m_remaining = 32; break;
+            default:
+                spdlog::warn("unknown mdec command 0x{:08x}", m_command);
+                m_remaining = 0;
+                break;
+            }
+
+            m_params.clear();
+
+            if (m_remaining == 0) {
+                Execute();
+            }
+
+            continue;
+        }
+
+        const size_t count = std::min(words, m_remaining);
+
+        m_params.insert(m_params.end(), data, data + count);
+
+        data += count;
+        words -= count;
+        m_remaining -= count;
+
+        if (m_remaining == 0) {
+            Execute();
+        }
+    }
+}
+
+void Mdec::Execute()
+{
+    switch (m_command >> 29) {
+    case 1: StartDecode(); break;
+    case 2: SetQuantTables(); break;
+    case 3: SetScaleTable(); break;
+    default: break;
+    }
+}
+
+void Mdec::StartDecode()
+{
+    /* anything the previous decode left unread is lost */
+    WaitIdle();
+
+    m_depth = static_cast<Depth>((m_command >> 27) & 0x3);
+    m_signed = (m_command & (1 << 26)) != 0;
+    m_bit15 = (m_command & (1 << 25)) != 0;
+
+    m_input.resize(2 * m_params.size());
+
+    for (size_t i = 0; i < m_params.size(); ++i) {
+        m_input[2 * i] = m_params[i] & 0xffff;
+        m_input[2 * i + 1] = m_params[i] >> 16;
+    }
+
+    /* every block takes at least two halfwords, which bounds the output */
+    const size_t macroblocks = m_input.size() / (2 * BlocksPerMacroblock());
+
+    m_output.resize(macroblocks * WordsPerMacroblock());
+    m_output_read = 0;
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy = true;
+        m_produced = 0;
+    }
+
+    m_request.notify_one();
+
+    m_emulator->m_dmac->Request(Dmac::Channel::MdecOut);
+}
+
+void Mdec::SetQuantTables()
+{
+    WaitIdle();
+
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(m_params.data());
+
+    std::copy_n(bytes, 64, m_luma_quant.begin());
+
+    if (m_command & 1) {
+        std::copy_n(bytes + 64, 64, m_chroma_quant.begin());
+    }
+}
+
+void Mdec::SetScaleTable()
+{
+    WaitIdle();
+
+    for (size_t i = 0; i < 32; ++i) {
+        /* the hardware drops the low bits of each entry */
+        m_scale[2 * i] = static_cast<int16_t>(m_params[i] & 0xffff) >> 3;
+        m_scale[2 * i + 1] = static_cast<int16_t>(m_params[i] >> 16) >> 3;
+    }
+
+    for (size_t p = 0; p < 4; ++p) {
+        for (size_t x = 0; x < 8; ++x) {
+            m_scale_pairs[16 * p + 2 * x] = m_scale[8 * (2 * p) + x];
+            m_scale_pairs[16 * p + 2 * x + 1] = m_scale[8 * (2 * p + 1) + x];
+        }
+    }
+}
+
+void Mdec::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_progress.wait(lock, [&]() { return !m_busy; });
+}
+
+void Mdec::WaitOutput(size_t words)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_progress.wait(lock, [&]() { return !m_busy || m_produced >= words; });
+}
+
+void Mdec::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_request.wait(lock, [&]() { return m_stop || m_busy; });
+
+        if (m_stop) {
+            return;
+        }
+
+        /* the cpu leaves the input, tables and mode alone until the decode is idle */
+        lock.unlock();
+        DecodeMacroblocks();
+        lock.lock();
+
+        m_busy = false;
+        m_progress.notify_all();
+    }
+}
+
+void Mdec::DecodeMacroblocks()
+{
+    const size_t blocks = BlocksPerMacroblock();
+    const size_t words = WordsPerMacroblock();
+
+    /* cr, cb, then the four luminance blocks */
+    alignas(16) Block macroblock[6];
+
+    size_t pos = 0;
+
+    for (size_t out = 0; out + words <= m_output.size(); out += words) {
+        for (size_t i = 0; i < blocks; ++i) {
+            const uint8_t *quant = (blocks == 6 && i < 2) ? m_chroma_quant.data() : m_luma_quant.data();
+
+            if (!DecodeBlock(pos, quant, macroblock[i])) {
+                return;
+            }
+
+            Idct(macroblock[i]);
+        }
+
+        if (blocks == 6) {
+            OutputColor(macroblock, &m_output[out]);
+        } else {
+            OutputMono(macroblock[0], &m_output[out]);
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_produced = out + words;
+        m_progress.notify_all();
+    }
+}
+
+bool Mdec::DecodeBlock(size_t& pos, const uint8_t *quant, Block& block) const
+{
+    const size_t size = m_input.size();
+
+    while (pos < size && m_input[pos] == EndOfBlock) {
+        ++pos;
+    }
+
+    if (pos == size) {
+        return false;
+    }
+
+    block.fill(0);
+
+    uint16_t n = m_input[pos++];
+
+    const int32_t scale = (n >> 10) & 0x3f;
+    int32_t value = SignExtend<10, int32_t>(n) * quant[0];
+    size_t k = 0;
+
+    for (;;) {
+        /* an unscaled block holds raw coefficients in raster order */
+        if (scale == 0) {
+            value = SignExtend<10, int32_t>(n) * 2;
+        }
+
+        block[scale == 0 ? k : ZigZag[k]] = std::clamp(value, -0x400, 0x3ff);
+
+        if (pos == size) {
+            break;
+        }
+
+        n = m_input[pos++];
+        k += ((n >> 10) & 0x3f) + 1;
+
+        if (k > 63) {
+            break;
+        }
+
+        value = (SignExtend<10, int32_t>(n) * quant[k] * scale + 4) / 8;
+    }
+
+    return true;
+}
+
+/*
+ * Two passes of dst[y][x] = sum over z of src[z][y] * scale[z][x], each
+ * transposing, so the pair of them gives the 2d transform.
+ */
+void Mdec::Idct(Block& block) const
+{
+    alignas(16) Block temp;
+
+    int16_t *src = block.data();
+    int16_t *dst = temp.data();
+
+    for (size_t pass = 0; pass < 2; ++pass) {
+#if defined(__SSE2__)
+        /* pairs of adjacent rows interleaved, one 32-bit pair per column */
+        alignas(16) int32_t pairs[4][8];
+
+        for (size_t p = 0; p < 4; ++p) {
+            const __m128i row0 = _mm_load_si128(reinterpret_cast<const __m128i *>(&src[8 * (2 * p)]));
+            const __m128i row1 = _mm_load_si128(reinterpret_cast<const __m128i *>(&src[8 * (2 * p + 1)]));
+
+            _mm_store_si128(reinterpret_cast<__m128i *>(&pairs[p][0]), _mm_unpacklo_epi16(row0, row1));
+            _mm_store_si128(reinterpret_cast<__m128i *>(&pairs[p][4]), _mm_unpackhi_epi16(row0, row1));
+        }
+
+        const __m128i round = _mm_set1_epi32(0x1000);
+
+        for (size_t y = 0; y < 8; ++y) {
+            __m128i lo = round;
+            __m128i hi = round;
+
+            for (size_t p = 0; p < 4; ++p) {
+                const __m128i coefficients = _mm_set1_epi32(pairs[p][y]);
+
+                const __m128i scale_lo = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_scale_pairs[16 * p]));
+                const __m128i scale_hi = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_scale_pairs[16 * p + 8]));
+
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(coefficients, scale_lo));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(coefficients, scale_hi));
+            }
+
+            const __m128i row = _mm_packs_epi32(_mm_srai_epi32(lo, 13), _mm_srai_epi32(hi, 13));
+            _mm_store_si128(reinterpret_cast<__m128i *>(&dst[8 * y]), row);
+        }
+#else
+        for (size_t y = 0; y < 8; ++y) {
+            for (size_t x = 0; x < 8; ++x) {
+                int32_t sum = 0x1000;
+
+                for (size_t z = 0; z < 8; ++z) {
+                    sum += src[y + 8 * z] * m_scale[x + 8 * z];
+                }
+
+                dst[x + 8 * y] = std::clamp(sum >> 13, INT16_MIN, INT16_MAX);
+            }
+        }
+#endif
+
+        std::swap(src, dst);
+    }
+}
+
+void Mdec::OutputColor(const Block *blocks, uint32_t *output) const
+{
+    const Block& cr = blocks[0];
+    const Block& cb = blocks[1];
+
+    const int32_t flip = m_signed ? 0 : 0x80;
+
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(output);
+    uint16_t *halves = reinterpret_cast<uint16_t *>(output);
+
+    for (size_t y = 0; y < 16; ++y) {
+        for (size_t x = 0; x < 16; ++x) {
+            const Block& luma = blocks[2 + 2 * (y / 8) + x / 8];
+
+            const int32_t l = luma[(x % 8) + 8 * (y % 8)];
+            const int32_t v = cr[x / 2 + 8 * (y / 2)];
+            const int32_t u = cb[x / 2 + 8 * (y / 2)];
+
+            /* 1.402, -0.3437, -0.7143 and 1.772 in 8-bit fixed point */
+            const int32_t r = (std::clamp(l + ((359 * v) >> 8), -128, 127) ^ flip) & 0xff;
+            const int32_t g = (std::clamp(l + ((-88 * u - 183 * v) >> 8), -128, 127) ^ flip) & 0xff;
+            const int32_t b = (std::clamp(l + ((454 * u) >> 8), -128, 127) ^ flip) & 0xff;
+
+            const size_t pixel = 16 * y + x;
+
+            if (m_depth == Depth24) {
+                bytes[3 * pixel] = r;
+                bytes[3 * pixel + 1] = g;
+                bytes[3 * pixel + 2] = b;
+            } else {
+                halves[pixel] = (r >> 3) | ((g >> 3) << 5) | ((b >> 3) << 10) | (m_bit15 << 15);
+            }
+        }
+    }
+}
+
+void Mdec::OutputMono(const Block& block, uint32_t *output) const
+{
+    const int32_t flip = m_signed ? 0 : 0x80;
+
+    uint8_t *bytes = reinterpret_cast<uint8_t *>(output);
+
+    for (size_t i = 0; i < 64; ++i) {
+        const int32_t l = std::clamp(SignExtend<9, int32_t>(block[i]), -128, 127);
+        const uint8_t value = (l ^ flip) & 0xff;
+
+        if (m_depth == Depth8) {
+            bytes[i] = value;
+        } else if (i % 2 == 0) {
+            bytes[i / 2] = value >> 4;
+        } else {
+            bytes[i / 2] |= value & 0xf0;
+        }
+    }
+}
+
+size_t Mdec::BlocksPerMacroblock() const
+{
+    return (m_depth == Depth24 || m_depth == Depth15) ? 6 : 1;
+}
+
+size_t Mdec::WordsPerMacroblock() const
+{
+    switch (m_depth) {
+    case Depth4: return 8;
+    case Depth8: return 16;
+    case Depth24: return 192;
+    case Depth15: return 128;
+    }
+
+    return 0;
+}
+
+}
@@ -0,0 +1,114 @@
+#ifndef CORE_MDEC_HPP
+#define CORE_MDEC_HPP
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <common/serializer.hpp>
+
+namespace Core
+{
+
+class Emulator;
+
+/*
+ * Motion decoder. Commands and their parameters arrive through the
+ * command register or dma0. A decode command is handed whole to a
+ * worker thread, and its output is collected through dma1 or the data
+ * register, waiting only if the worker has not yet produced enough.
+ */
+class Mdec {
+public:
+    Mdec(Emulator *emulator);
+    ~Mdec();
+
+    void Reset();
+
+    /* waits out a running decode, so its output is complete when saved */
+    void DoState(Serializer& s);
+
+    uint32_t Read(uint32_t addr);
+    void Write(uint32_t addr, uint32_t data);
+
+    void WriteDmaBlock(const uint32_t *data, size_t words);
+    void ReadDmaBlock(uint32_t *data, size_t words);
+
+    /* true from the start of a decode until all of its output has been read */
+    bool OutputPending() const;
+
+    /* cpu cycles the hardware would spend producing this many output words */
+    int64_t OutputCycles(size_t words) const;
+
+private:
+    enum Depth : uint32_t { Depth4, Depth8, Depth24, Depth15 };
+
+    /* approximate cpu cycles to decode one 8x8 block */
+    static constexpr int64_t BlockCycles = 448;
+
+    using Block = std::array<int16_t, 64>;
+
+    void Push(const uint32_t *data, size_t words);
+    void Execute();
+
+    void StartDecode();
+    void SetQuantTables();
+    void SetScaleTable();
+
+    void WaitIdle();
+    void WaitOutput(size_t words);
+
+    void Run();
+
+    /* worker side, reading m_input and filling m_output */
+    void DecodeMacroblocks();
+    bool DecodeBlock(size_t& pos, const uint8_t *quant, Block& block) const;
+    void Idct(Block& block) const;
+
+    void OutputColor(const Block *blocks, uint32_t *output) const;
+    void OutputMono(const Block& block, uint32_t *output) const;
+
+    size_t BlocksPerMacroblock() const;
+    size_t WordsPerMacroblock() const;
+
+    /* command currently receiving parameters, or the last one run */
+    uint32_t m_command;
+    size_t m_remaining;
+    std::vector<uint32_t> m_params;
+
+    bool m_data_in_enable, m_data_out_enable;
+
+    Depth m_depth;
+    bool m_signed, m_bit15;
+
+    /* quantisation tables in zigzag order */
+    std::array<uint8_t, 64> m_luma_quant = {}, m_chroma_quant = {};
+
+    /* scale table rows, and adjacent rows interleaved for the vector idct */
+    alignas(16) std::array<int16_t, 64> m_scale = {};
+    alignas(16) std::array<int16_t, 64> m_scale_pairs = {};
+
+    std::vector<uint16_t> m_input;
+    std::vector<uint32_t> m_output;
+    size_t m_output_read;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_request, m_progress;
+
+    std::thread m_thread;
+    bool m_stop;
+
+    /* guarded by m_mutex */
+    bool m_busy;
+    size_t m_produced;
+
+    Emulator *m_emulator;
+};
+
+}
+
+#endif /* CORE_MDEC_HPP */
@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(BTPSX_HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
+#include <common/serializer.hpp>
+
+#include <spdlog/spdlog.h>
+
+#include "emulator.hpp"
+#include "error.hpp"
+#include "gpu.hpp"
+#include "save_state.hpp"
+#include "spu.hpp"
+
+namespace Core
+{
+
+static constexpr char StateMagic[8] = { 'B', 'T', 'P', 'S', 'X', 'S', 'T', 'A' };
+
+struct StateHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t size;
+};
+
+enum StateFlags : uint32_t {
+    Deflated = 0x1
+};
+
+static constexpr size_t VramSize = 1024 * 512 * sizeof(uint16_t);
+
+/* leaves output alone and returns false if the data cannot be compressed */
+static bool Deflate(const std::vector<uint8_t>& data, std::vector<uint8_t>& output)
+{
+#if defined(BTPSX_HAVE_ZLIB)
+    uLongf length = compressBound(data.size());
+    std::vector<uint8_t> deflated(length);
+
+    if (compress2(deflated.data(), &length, data.data(), data.size(), Z_BEST_SPEED) != Z_OK) {
+        return false;
+    }
+
+    deflated.resize(length);
+    output.swap(deflated);
+    return true;
+#else
+    (void)data;
+    (void)output;
+    return false;
+#endif
+}
+
+static void Inflate(const std::vector<uint8_t>& data, uint8_t *output, size_t length)
+{
+#if defined(BTPSX_HAVE_ZLIB)
+    uLongf produced = length;
+
+    if (uncompress(output, &produced, data.data(), data.size()) != Z_OK || produced != length) {
+        Error("corrupt compressed state");
+    }
+#else
+    (void)data;
+    (void)output;
+    (void)length;
+    Error("compressed state without zlib support");
+#endif
+}
+
+SaveStates::SaveStates(Emulator *emulator, size_t capacity, size_t keyframe_interval, bool compress)
+    : m_emulator(emulator),
+      m_capacity(std::max<size_t>(capacity, 1)),
+      m_keyframe_interval(std::max<size_t>(keyframe_interval, 1)),
+#if defined(BTPSX_HAVE_ZLIB)
+      m_compress(compress)
+#else
+      m_compress(false)
+#endif
+{
+    (void)compress;
+
+    m_since_keyframe = 0;
+
+    const uint8_t *vram = RegionData(m_emulator, Region::Vram);
+    m_vram_shadow.assign(vram, vram + VramSize);
+
+    m_stop = false;
+    m_busy = false;
+
+    if (m_compress) {
+        m_thread = std::thread(&SaveStates::Run, this);
+    }
+}
+
+SaveStates::~SaveStates()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+
+    m_request.notify_one();
+    m_thread.join();
+}
+
+uint8_t * SaveStates::RegionData(Emulator *emulator, Region region)
+{
+    switch (region) {
+    case Region::Ram: return emulator->m_ram.data();
+    case Region::Vram: return reinterpret_cast<uint8_t *>(emulator->m_gpu->Vram());
+    case Region::SoundRam: return reinterpret_cast<uint8_t *>(emulator->m_spu->SoundRam());
+    default: Error("invalid state region {}", region);
+    }
+}
+
+size_t SaveStates::RegionPages(Region region)
+{
+    switch (region) {
+    case Region::Ram: return Emulator::RamSize >> PageShift;
+    case Region::Vram: return VramSize >> PageShift;
+    case Region::SoundRam: return Spu::SoundRamPages::Count;
+    default: Error("invalid state region {}", region);
+    }
+}
+
+bool SaveStates::PageDirty(Region region, size_t index) const
+{
+    switch (region) {
+    case Region::Ram:
+        return m_emulator->m_ram_dirty.Test(index);
+    case Region::Vram: {
+        const size_t offset = index << PageShift;
+        return std::memcmp(RegionData(m_emulator, region) + offset, &m_vram_shadow[offset], PageSize) != 0;
+    }
+    case Region::SoundRam:
+        return m_emulator->m_spu->SoundRamDirty().Test(index);
+    default: Error("invalid state region {}", region);
+    }
+}
+
+void SaveStates::ClearDirty()
+{
+    m_emulator->m_ram_dirty.Clear();
+    m_emulator->m_spu->SoundRamDirty().Clear();
+}
+
+void SaveStates::Capture()
+{
+    auto snapshot = std::make_shared<Snapshot>();
+
+    snapshot->keyframe = m_snapshots.empty() || m_since_keyframe >= m_keyframe_interval;
+
+    if (!m_snapshots.empty()) {
+        snapshot->registers.reserve(m_snapshots.back()->registers.size());
+    }
+
+    Serializer s(snapshot->registers);
+    m_emulator->DoState(s);
+
+    for (size_t r = 0; r < Region::RegionCount; ++r) {
+        const Region region = static_cast<Region>(r);
+
+        for (size_t i = 0; i < RegionPages(region); ++i) {
+            if (snapshot->keyframe || PageDirty(region, i)) {
+                snapshot->pages.push_back({ region, static_cast<uint16_t>(i) });
+            }
+        }
+    }
+
+    snapshot->data.resize(snapshot->pages.size() * PageSize);
+
+    uint8_t *data = snapshot->data.data();
+
+    for (const PageRef& page : snapshot->pages) {
+        const size_t offset = size_t(page.index) << PageShift;
+        const uint8_t *source = RegionData(m_emulator, page.region) + offset;
+
+        std::memcpy(data, source, PageSize);
+
+        if (page.region == Region::Vram) {
+            std::memcpy(&m_vram_shadow[offset], source, PageSize);
+        }
+
+        data += PageSize;
+    }
+
+    ClearDirty();
+
+    m_since_keyframe = snapshot->keyframe ? 1 : m_since_keyframe + 1;
+    m_snapshots.push_back(snapshot);
+
+    /* history goes a keyframe and its deltas at a time, and only while a later keyframe remains */
+    while (m_snapshots.size() > m_capacity) {
+        auto next = std::find_if(m_snapshots.begin() + 1, m_snapshots.end(),
+                                 [](const std::shared_ptr<Snapshot>& s) { return s->keyframe; });
+
+        if (next == m_snapshots.end()) {
+            break;
+        }
+
+        m_snapshots.erase(m_snapshots.begin(), next);
+    }
+
+    if (m_compress && !snapshot->data.empty()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(snapshot));
+        }
+
+        m_request.notify_one();
+    }
+}
+
+void SaveStates::Restore(size_t back)
+{
+    if (back >= m_snapshots.size()) {
+        Error("no capture {} back, only {} held", back, m_snapshots.size());
+    }
+
+    WaitIdle();
+
+    const size_t target = m_snapshots.size() - 1 - back;
+    size_t key = target;
+
+    while (!m_snapshots[key]->keyframe) {
+        --key;
+    }
+
+    /* newest copy of each page wins, walking back until the keyframe has filled the rest */
+    std::vector<bool> restored[Region::RegionCount];
+
+    for (size_t r = 0; r < Region::RegionCount; ++r) {
+        restored[r].resize(RegionPages(static_cast<Region>(r)));
+    }
+
+    std::vector<uint8_t> scratch;
+
+    for (size_t i = target + 1; i-- > key;) {
+        const Snapshot& snapshot = *m_snapshots[i];
+        const uint8_t *data = PageData(snapshot, scratch);
+
+        for (const PageRef& page : snapshot.pages) {
+            const uint8_t *source = data;
+            data += PageSize;
+
+            if (restored[page.region][page.index]) {
+                continue;
+            }
+
+            restored[page.region][page.index] = true;
+
+            const size_t offset = size_t(page.index) << PageShift;
+            uint8_t *dest = RegionData(m_emulator, page.region) + offset;
+
+            /* compiled code survives for ram pages that come back unchanged */
+            if (std::memcmp(dest, source, PageSize) == 0) {
+                continue;
+            }
+
+            std::memcpy(dest, source, PageSize);
+
+            if (page.region == Region::Ram) {
+                m_emulator->m_cpu->InvalidateCode(offset, PageSize);
+            }
+        }
+    }
+
+    const Snapshot& snapshot = *m_snapshots[target];
+
+    Serializer s(snapshot.registers.data(), snapshot.registers.size());
+    m_emulator->DoState(s);
+
+    const uint8_t *vram = RegionData(m_emulator, Region::Vram);
+    std::copy_n(vram, VramSize, m_vram_shadow.begin());
+
+    ClearDirty();
+
+    m_snapshots.erase(m_snapshots.begin() + target + 1, m_snapshots.end());
+    m_since_keyframe = target - key + 1;
+}
+
+const uint8_t * SaveStates::PageData(const Snapshot& snapshot, std::vector<uint8_t>& scratch) const
+{
+    if (!snapshot.compressed) {
+        return snapshot.data.data();
+    }
+
+    scratch.resize(snapshot.pages.size() * PageSize);
+    Inflate(snapshot.data, scratch.data(), scratch.size());
+
+    return scratch.data();
+}
+
+void SaveStates::Save(Emulator *emulator, const std::filesystem::path& filepath)
+{
+    std::vector<uint8_t> state;
+    Serializer s(state);
+
+    /* memory ahead of the registers, since some components rebuild caches from it on load */
+    for (size_t r = 0; r < Region::RegionCount; ++r) {
+        const Region region = static_cast<Region>(r);
+        s.DoBytes(RegionData(emulator, region), RegionPages(region) * PageSize);
+    }
+
+    emulator->DoState(s);
+
+    StateHeader header;
+
+    std::memcpy(header.magic, StateMagic, sizeof(StateMagic));
+    header.version = Version;
+    header.flags = 0;
+    header.size = state.size();
+
+    std::vector<uint8_t> deflated;
+
+    if (Deflate(state, deflated)) {
+        header.flags |= StateFlags::Deflated;
+        state.swap(deflated);
+    }
+
+    std::ofstream f(filepath, std::ios::binary);
+
+    if (!f.is_open()) {
+        Error("unable to create {}", filepath.filename().string());
+    }
+
+    f.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    f.write(reinterpret_cast<const char *>(state.data()), state.size());
+
+    if (!f) {
+        Error("unable to write {}", filepath.filename().string());
+    }
+}
+
+void SaveStates::Load(Emulator *emulator, const std::filesystem::path& filepath)
+{
+    std::ifstream f(filepath, std::ios::binary);
+
+    if (!f.is_open()) {
+        Error("unable to open {}", filepath.filename().string());
+    }
+
+    StateHeader header;
+    f.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+    if (!f || std::memcmp(header.magic, StateMagic, sizeof(StateMagic)) != 0) {
+        Error("{} is not a save state", filepath.filename().string());
+    }
+
+    if (header.version != Version) {
+        Error("{} has state version {}, expected {}", filepath.filename().string(), header.version, Version);
+    }
+
+    std::vector<uint8_t> contents((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    std::vector<uint8_t> state;
+
+    if (header.flags & StateFlags::Deflated) {
+        state.resize(header.size);
+        Inflate(contents, state.data(), state.size());
+    } else {
+        state = std::move(contents);
+    }
+
+    Serializer s(state.data(), state.size());
+
+    for (size_t r = 0; r < Region::RegionCount; ++r) {
+        const Region region = static_cast<Region>(r);
+        s.DoBytes(RegionData(emulator, region), RegionPages(region) * PageSize);
+    }
+
+    emulator->DoState(s);
+
+    /* everything changed at once, as far as compiled code and any history are concerned */
+    emulator->RamWritten(0, Emulator::RamSize);
+    emulator->m_spu->SoundRamDirty().MarkAll();
+
+    spdlog::info("loaded state from {}", filepath.filename().string());
+}
+
+void SaveStates::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_progress.wait(lock, [&]() { return m_queue.empty() && !m_busy; });
+}
+
+void SaveStates::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    for (;;) {
+        m_request.wait(lock, [&]() { return m_stop || !m_queue.empty(); });
+
+        if (m_stop) {
+            return;
+        }
+
+        const std::shared_ptr<Snapshot> snapshot = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_busy = true;
+
+        /* the emulator thread leaves queued page data alone until it has waited for idle */
+        lock.unlock();
+
+        std::vector<uint8_t> deflated;
+        const bool compressed = Deflate(snapshot->data, deflated);
+
+        lock.lock();
+
+        if (compressed) {
+            snapshot->data.swap(deflated);
+            snapshot->compressed = true;
+        }
+
+        m_busy = false;
+        m_progress.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,104 @@
+#ifndef CORE_SAVE_STATE_HPP
+#define CORE_SAVE_STATE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Core
+{
+
+class Emulator;
+
+/*
+ * A history of snapshots of a running machine, cheap enough to take
+ * every frame. Each capture keeps the registers whole but only the 4 KiB
+ * pages of ram, vram and sound ram changed since the capture before it;
+ * every so often a keyframe keeps every page, so a restore never walks
+ * back past one. Page data is compressed on a worker thread when zlib is
+ * available. Only one history may follow an emulator at a time, since
+ * capturing clears its dirty pages.
+ */
+class SaveStates {
+public:
+    /* bumped whenever the shape of any component's state changes */
+    static constexpr uint32_t Version = 2;
+
+    SaveStates(Emulator *emulator, size_t capacity, size_t keyframe_interval, bool compress = true);
+    ~SaveStates();
+
+    void Capture();
+
+    /* returns to the capture made back captures before the latest, dropping the ones after it */
+    void Restore(size_t back);
+
+    inline size_t Count() const { return m_snapshots.size(); }
+
+    /* complete states on disk, independent of any history */
+    static void Save(Emulator *emulator, const std::filesystem::path& filepath);
+    static void Load(Emulator *emulator, const std::filesystem::path& filepath);
+
+private:
+    static constexpr size_t PageShift = 12;
+    static constexpr size_t PageSize = size_t(1) << PageShift;
+
+    enum Region : uint8_t { Ram, Vram, SoundRam, RegionCount };
+
+    struct PageRef {
+        Region region;
+        uint16_t index;
+    };
+
+    struct Snapshot {
+        bool keyframe;
+        std::vector<uint8_t> registers;
+
+        /* page contents in listed order, replaced by their deflated form once compressed */
+        std::vector<PageRef> pages;
+        std::vector<uint8_t> data;
+        bool compressed = false;
+    };
+
+    static uint8_t * RegionData(Emulator *emulator, Region region);
+    static size_t RegionPages(Region region);
+
+    bool PageDirty(Region region, size_t index) const;
+    void ClearDirty();
+
+    const uint8_t * PageData(const Snapshot& snapshot, std::vector<uint8_t>& scratch) const;
+
+    void WaitIdle();
+    void Run();
+
+    Emulator *m_emulator;
+
+    const size_t m_capacity;
+    const size_t m_keyframe_interval;
+    const bool m_compress;
+
+    std::deque<std::shared_ptr<Snapshot>> m_snapshots;
+    size_t m_since_keyframe;
+
+    /* vram as of the last capture; the rasteriser's writes are too scattered to track */
+    std::vector<uint8_t> m_vram_shadow;
+
+    std::mutex m_mutex;
+    std::condition_variable m_request, m_progress;
+
+    std::thread m_thread;
+    bool m_stop;
+
+    /* guarded by m_mutex */
+    std::deque<std::shared_ptr<Snapshot>> m_queue;
+    bool m_busy;
+};
+
+}
+
+#endif /* CORE_SAVE_STATE_HPP */
@@ -1,5 +1,7 @@
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
+#include <utility>
 
 #include <common/types.hpp>
 
@@ -19,12 +21,23 @@ Scheduler::Scheduler()
 void Scheduler::UpdateEvents()
 {
     while (NextEventTarget() <= 0) {
-        const Event *event = m_event_list.front();
-        event->callback();
+        Event *event = m_event_list.front();
 
+        /* one-shot events retire before firing so the callback may re-arm them */
         if (event->mode == Event::Mode::Once) {
+            const Event::Callback callback = std::move(event->callback);
+
+            event->active = false;
             m_event_list.pop_front();
-        } else if (event->mode == Event::Mode::Periodic) {
+            RecalcNextEventTarget();
+
+            callback();
+            continue;
+        }
+
+        event->callback();
+
+        if (event->mode == Event::Mode::Periodic) {
             RescheduleEvent(event->type, event->period);
         }
     }
@@ -76,3 +89,46 @@ void Scheduler::RescheduleEvent(Event::Type type, std::size_t ticks)
     SortEvents();
     RecalcNextEventTarget();
 }
+
+void Scheduler::DoState(Serializer& s)
+{
+    s.Do(m_current_time);
+
+    if (s.Loading()) {
+        RecalcNextEventTarget();
+    }
+}
+
+void Scheduler::DoEvent(Serializer& s, Event::Type type, Event::Callback callback)
+{
+    assert(type != Event::Type::Idle && type != Event::Type::Count);
+
+    Event& event = m_events[type];
+
+    bool active = event.active;
+    Event::Mode mode = event.mode;
+    s64 remaining = event.target - m_current_time;
+    s64 period = event.period;
+
+    s.Do(active);
+    s.Do(mode);
+    s.Do(remaining);
+    s.Do(period);
+
+    if (!s.Loading()) {
+        return;
+    }
+
+    if (!callback) {
+        callback = event.callback;
+    }
+
+    if (event.active) {
+        RemoveEvent(type);
+    }
+
+    if (active) {
+        AddEvent(type, mode, std::max<s64>(remaining, 0), std::move(callback));
+        event.period = period;
+    }
+}
@@ -5,6 +5,7 @@
 #include <functional>
 #include <list>
 
+#include <common/serializer.hpp>
 #include <common/types.hpp>
 
 class Scheduler {
@@ -19,6 +20,16 @@ public:
             CdCommand2,
             CdSector,
             IoAcknowledge,
+            DmaMdecIn,
+            DmaMdecOut,
+            DmaGpu,
+            DmaCdrom,
+            DmaSpu,
+            DmaPio,
+            DmaOtc,
+            Timer0,
+            Timer1,
+            Timer2,
             Count
         };
 
@@ -45,6 +56,16 @@ public:
     void RemoveEvent(Event::Type type);
     void RescheduleEvent(Event::Type type, std::size_t ticks);
 
+    /* the clock; restored ahead of the events, whose owners re-arm them */
+    void DoState(Serializer& s);
+
+    /*
+     * Saves or restores one event's timing. Callbacks cannot be saved, so
+     * on load the owner passes the one it would have armed the event with,
+     * or none to keep the event's current callback.
+     */
+    void DoEvent(Serializer& s, Event::Type type, Event::Callback callback = nullptr);
+
     inline void Tick(s64 ticks)
     {
         assert(ticks >= 0);
@@ -53,6 +74,8 @@ public:
         m_next_event_target -= ticks;
     }
 
+    inline bool EventActive(Event::Type type) const { return m_events[type].active; }
+
     inline s64 CurrentTime() const { return m_current_time; }
     inline s64 NextEventTarget() const { return m_next_event_target; }
 
@@ -1,25 +1,239 @@
+#include <algorithm>
+#include <array>
 #include <cstdint>
+#include <cstring>
 #include <mutex>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <common/signextend.hpp>
 
 #include <spdlog/spdlog.h>
 
+#include "emulator.hpp"
 #include "error.hpp"
+#include "scheduler.hpp"
 #include "spu.hpp"
 
 namespace Core
 {
 
-Spu::Spu(bool enable_audio) : m_enable_audio{enable_audio} {}
+static_assert(Spu::SampleCycles == Emulator::CpuFrequency / 44100);
+
+/*
+ * The console's interpolation table. For a position i of 256 between two
+ * samples, the four newest samples are weighted by entries 0xff - i,
+ * 0x1ff - i, 0x100 + i and i.
+ */
+static constexpr std::array<int16_t, 512> GaussianTable = {
+    -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+    -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001, -0x001,
+    0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000, 0x0001,
+    0x0001, 0x0001, 0x0001, 0x0002, 0x0002, 0x0002, 0x0003, 0x0003,
+    0x0003, 0x0004, 0x0004, 0x0005, 0x0005, 0x0006, 0x0007, 0x0007,
+    0x0008, 0x0009, 0x0009, 0x000a, 0x000b, 0x000c, 0x000d, 0x000e,
+    0x000f, 0x0010, 0x0011, 0x0012, 0x0013, 0x0015, 0x0016, 0x0018,
+    0x0019, 0x001b, 0x001c, 0x001e, 0x0020, 0x0021, 0x0023, 0x0025,
+    0x0027, 0x0029, 0x002c, 0x002e, 0x0030, 0x0033, 0x0035, 0x0038,
+    0x003a, 0x003d, 0x0040, 0x0043, 0x0046, 0x0049, 0x004d, 0x0050,
+    0x0054, 0x0057, 0x005b, 0x005f, 0x0063, 0x0067, 0x006b, 0x006f,
+    0x0074, 0x0078, 0x007d, 0x0082, 0x0087, 0x008c, 0x0091, 0x0096,
+    0x009c, 0x00a1, 0x00a7, 0x00ad, 0x00b3, 0x00ba, 0x00c0, 0x00c7,
+    0x00cd, 0x00d4, 0x00db, 0x00e3, 0x00ea, 0x00f2, 0x00fa, 0x0101,
+    0x010a, 0x0112, 0x011b, 0x0123, 0x012c, 0x0135, 0x013f, 0x0148,
+    0x0152, 0x015c, 0x0166, 0x0171, 0x017b, 0x0186, 0x0191, 0x019c,
+    0x01a8, 0x01b4, 0x01c0, 0x01cc, 0x01d9, 0x01e5, 0x01f2, 0x0200,
+    0x020d, 0x021b, 0x0229, 0x0237, 0x0246, 0x0255, 0x0264, 0x0273,
+    0x0283, 0x0293, 0x02a3, 0x02b4, 0x02c4, 0x02d6, 0x02e7, 0x02f9,
+    0x030b, 0x031d, 0x0330, 0x0343, 0x0356, 0x036a, 0x037e, 0x0392,
+    0x03a7, 0x03bc, 0x03d1, 0x03e7, 0x03fc, 0x0413, 0x042a, 0x0441,
+    0x0458, 0x0470, 0x0488, 0x04a0, 0x04b9, 0x04d2, 0x04ec, 0x0506,
+    0x0520, 0x053b, 0x0556, 0x0572, 0x058e, 0x05aa, 0x05c7, 0x05e4,
+    0x0601, 0x061f, 0x063e, 0x065c, 0x067c, 0x069b, 0x06bb, 0x06dc,
+    0x06fd, 0x071e, 0x0740, 0x0762, 0x0784, 0x07a7, 0x07cb, 0x07ef,
+    0x0813, 0x0838, 0x085d, 0x0883, 0x08a9, 0x08d0, 0x08f7, 0x091e,
+    0x0946, 0x096f, 0x0998, 0x09c1, 0x09eb, 0x0a16, 0x0a40, 0x0a6c,
+    0x0a98, 0x0ac4, 0x0af1, 0x0b1e, 0x0b4c, 0x0b7a, 0x0ba9, 0x0bd8,
+    0x0c07, 0x0c38, 0x0c68, 0x0c99, 0x0ccb, 0x0cfd, 0x0d30, 0x0d63,
+    0x0d97, 0x0dcb, 0x0e00, 0x0e35, 0x0e6b, 0x0ea1, 0x0ed7, 0x0f0f,
+    0x0f46, 0x0f7f, 0x0fb7, 0x0ff1, 0x102a, 0x1065, 0x109f, 0x10db,
+    0x1116, 0x1153, 0x118f, 0x11cd, 0x120b, 0x1249, 0x1288, 0x12c7,
+    0x1307, 0x1347, 0x1388, 0x13c9, 0x140b, 0x144d, 0x1490, 0x14d4,
+    0x1517, 0x155c, 0x15a0, 0x15e6, 0x162c, 0x1672, 0x16b9, 0x1700,
+    0x1747, 0x1790, 0x17d8, 0x1821, 0x186b, 0x18b5, 0x1900, 0x194b,
+    0x1996, 0x19e2, 0x1a2e, 0x1a7b, 0x1ac8, 0x1b16, 0x1b64, 0x1bb3,
+    0x1c02, 0x1c51, 0x1ca1, 0x1cf1, 0x1d42, 0x1d93, 0x1de5, 0x1e37,
+    0x1e89, 0x1edc, 0x1f2f, 0x1f82, 0x1fd6, 0x202a, 0x207f, 0x20d4,
+    0x2129, 0x217f, 0x21d5, 0x222c, 0x2282, 0x22da, 0x2331, 0x2389,
+    0x23e1, 0x2439, 0x2492, 0x24eb, 0x2545, 0x259e, 0x25f8, 0x2653,
+    0x26ad, 0x2708, 0x2763, 0x27be, 0x281a, 0x2876, 0x28d2, 0x292e,
+    0x298b, 0x29e7, 0x2a44, 0x2aa1, 0x2aff, 0x2b5c, 0x2bba, 0x2c18,
+    0x2c76, 0x2cd4, 0x2d33, 0x2d91, 0x2df0, 0x2e4f, 0x2eae, 0x2f0d,
+    0x2f6c, 0x2fcc, 0x302b, 0x308b, 0x30ea, 0x314a, 0x31aa, 0x3209,
+    0x3269, 0x32c9, 0x3329, 0x3389, 0x33e9, 0x3449, 0x34a9, 0x3509,
+    0x3569, 0x35c9, 0x3629, 0x3689, 0x36e8, 0x3748, 0x37a8, 0x3807,
+    0x3867, 0x38c6, 0x3926, 0x3985, 0x39e4, 0x3a43, 0x3aa2, 0x3b00,
+    0x3b5f, 0x3bbd, 0x3c1b, 0x3c79, 0x3cd7, 0x3d35, 0x3d92, 0x3def,
+    0x3e4c, 0x3ea9, 0x3f05, 0x3f62, 0x3fbd, 0x4019, 0x4074, 0x40d0,
+    0x412a, 0x4185, 0x41df, 0x4239, 0x4292, 0x42eb, 0x4344, 0x439c,
+    0x43f4, 0x444c, 0x44a3, 0x44fa, 0x4550, 0x45a6, 0x45fc, 0x4651,
+    0x46a6, 0x46fa, 0x474e, 0x47a1, 0x47f4, 0x4846, 0x4898, 0x48e9,
+    0x493a, 0x498a, 0x49d9, 0x4a29, 0x4a77, 0x4ac5, 0x4b13, 0x4b5f,
+    0x4bac, 0x4bf7, 0x4c42, 0x4c8d, 0x4cd7, 0x4d20, 0x4d68, 0x4db0,
+    0x4df7, 0x4e3e, 0x4e84, 0x4ec9, 0x4f0e, 0x4f52, 0x4f95, 0x4fd7,
+    0x5019, 0x505a, 0x509a, 0x50da, 0x5118, 0x5156, 0x5194, 0x51d0,
+    0x520c, 0x5247, 0x5281, 0x52ba, 0x52f3, 0x532a, 0x5361, 0x5397,
+    0x53cc, 0x5401, 0x5434, 0x5467, 0x5499, 0x54ca, 0x54fa, 0x5529,
+    0x5558, 0x5585, 0x55b2, 0x55de, 0x5609, 0x5632, 0x565b, 0x5684,
+    0x56ab, 0x56d1, 0x56f6, 0x571b, 0x573e, 0x5761, 0x5782, 0x57a3,
+    0x57c3, 0x57e2, 0x57ff, 0x581c, 0x5838, 0x5853, 0x586d, 0x5886,
+    0x589e, 0x58b5, 0x58cb, 0x58e0, 0x58f4, 0x5907, 0x5919, 0x592a,
+    0x593a, 0x5949, 0x5958, 0x5965, 0x5971, 0x597c, 0x5986, 0x598f,
+    0x5997, 0x599e, 0x59a4, 0x59a9, 0x59ad, 0x59b0, 0x59b2, 0x59b3
+};
+
+/* the same weights regrouped by position, oldest sample first */
+static std::array<std::array<int16_t, 4>, 256> MakeGaussianTaps()
+{
+    std::array<std::array<int16_t, 4>, 256> taps;
+
+    for (size_t i = 0; i < 256; ++i) {
+        taps[i] = { GaussianTable[0xff - i], GaussianTable[0x1ff - i],
+                    GaussianTable[0x100 + i], GaussianTable[i] };
+    }
+
+    return taps;
+}
+
+static const std::array<std::array<int16_t, 4>, 256> GaussianTaps = MakeGaussianTaps();
+
+/* each product is shifted down before the sum, as the hardware does */
+static inline int32_t Interpolate(const int16_t *samples, const int16_t *taps)
+{
+#if defined(__SSE2__)
+    const __m128i s = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(samples));
+    const __m128i t = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(taps));
+
+    __m128i products = _mm_unpacklo_epi16(_mm_mullo_epi16(s, t), _mm_mulhi_epi16(s, t));
+    products = _mm_srai_epi32(products, 15);
+
+    products = _mm_add_epi32(products, _mm_shuffle_epi32(products, _MM_SHUFFLE(1, 0, 3, 2)));
+    products = _mm_add_epi32(products, _mm_shuffle_epi32(products, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(products);
+#else
+    int32_t sum = 0;
+
+    for (size_t i = 0; i < 4; ++i) {
+        sum += (samples[i] * taps[i]) >> 15;
+    }
+
+    return sum;
+#endif
+}
+
+Spu::Spu(Emulator *emulator, bool enable_audio)
+    : m_enable_audio{enable_audio}, m_emulator(emulator) {}
 
 void Spu::Reset()
 {
     KeyOff(0xffffffff);
+
+    m_noise_timer = 0;
+    m_noise_level = 0;
+
+    m_reverb_address = 4 * m_effect_base;
+    m_reverb_odd = false;
+    m_reverb_input[0] = m_reverb_input[1] = 0;
+    m_reverb_output[0] = m_reverb_output[1] = 0;
+
+    m_sync_time = m_emulator->m_scheduler->CurrentTime();
+}
+
+void Spu::DoState(Serializer& s)
+{
+    s.Section("SPU ");
+
+    s.Do(m_voices);
+    s.Do(m_lanes);
+
+    s.Do(m_pitch_mod_on);
+    s.Do(m_noise_on);
+    s.Do(m_effect_on);
+
+    s.Do(m_master_volume);
+    s.Do(m_effect_volume);
+    s.Do(m_cd_volume);
+    s.Do(m_external_volume);
+
+    s.Do(m_transfer_addr);
+    s.Do(m_transfer_current_addr);
+    s.Do(m_transfer_control);
+    s.Do(m_endx);
+    s.Do(m_control);
+    s.Do(m_status);
+
+    s.Do(m_effect_base);
+    s.Do(m_reverb_registers);
+    s.Do(m_reverb_address);
+    s.Do(m_reverb_odd);
+    s.Do(m_reverb_input);
+    s.Do(m_reverb_output);
+
+    s.Do(m_noise_timer);
+    s.Do(m_noise_level);
+
+    s.Do(m_sound_buffer_index);
+    s.Do(m_sound_buffer);
+    s.Do(m_sync_time);
+
+    if (!s.Loading()) {
+        return;
+    }
+
+    UpdateReverbTables();
+    InvalidateDecodeCache(0, SoundRamSize);
+
+    /* cd audio already queued belongs to the abandoned timeline */
+    int16_t discard[2];
+    while (m_cd_fifo.Dequeue(discard, 2) == 2) {}
 }
 
-void Spu::AdsrStep(Voice& voice)
+void Spu::Sync()
 {
+    const int64_t samples = (m_emulator->m_scheduler->CurrentTime() - m_sync_time) / SampleCycles;
+
+    m_sync_time += samples * SampleCycles;
+
+    for (int64_t i = 0; i < samples; i += BatchSamples) {
+        RenderBatch(std::min<size_t>(samples - i, BatchSamples));
+    }
+}
+
+void Spu::RenderBatch(size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        RenderVoices(&m_batch_dry[2 * i], &m_batch_effect[2 * i]);
+    }
+
+    if (m_control.effect_enable) {
+        ProcessReverb(count);
+    } else {
+        std::fill_n(m_batch_wet.begin(), 2 * count, 0);
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        OutputSample(&m_batch_dry[2 * i], &m_batch_wet[2 * i]);
+    }
+}
+
+void Spu::AdsrStep(size_t index)
+{
+    Voice& voice = m_voices[index];
+    int16_t& volume = m_lanes.envelope[index];
+
     if (--voice.adsr_counter != 0) {
         return;
     }
@@ -30,20 +244,20 @@ void Spu::AdsrStep(Voice& voice)
     case State::Attack: 
         step_shift = std::max(0, 11 - voice.adsr.attack_shift);
         step = (7 - voice.adsr.attack_step) << step_shift;
-        voice.adsr_volume = std::clamp(int32_t(voice.adsr_volume) + step, 0, INT16_MAX);
+        volume = std::clamp(int32_t(volume) + step, 0, INT16_MAX);
 
-        if (voice.adsr_volume == INT16_MAX) {
+        if (volume == INT16_MAX) {
             voice.state = State::Decay;
 
             shift = voice.adsr.decay_shift - 11;
             voice.adsr_counter = 1 << std::max(0, shift);
-            voice.adsr_counter = (voice.adsr_counter * voice.adsr_volume) >> 15;
+            voice.adsr_counter = (voice.adsr_counter * volume) >> 15;
         } else {
             shift = voice.adsr.attack_shift - 11;
             voice.adsr_counter = 1 << std::max(0, shift);
 
             if (voice.adsr.attack_mode == AdsrMode::Exponential
-                && voice.adsr_volume > 0x6000) {
+                && volume > 0x6000) {
                 voice.adsr_counter *= 4;
             }
         }
@@ -52,21 +266,21 @@ void Spu::AdsrStep(Voice& voice)
     case State::Decay:
         step_shift = std::max(0, 11 - voice.adsr.decay_shift);
         step = -8 << step_shift;
-        step = (step * voice.adsr_volume) >> 15;
+        step = (step * volume) >> 15;
 
-        voice.adsr_volume = std::clamp(int32_t(voice.adsr_volume) + step, 0, INT16_MAX);
+        volume = std::clamp(int32_t(volume) + step, 0, INT16_MAX);
 
-        if (voice.adsr_volume <= 0x800 * (voice.adsr.sustain_level + 1)) {
+        if (volume <= 0x800 * (voice.adsr.sustain_level + 1)) {
             voice.state = State::Sustain;
 
-            voice.adsr_volume = 0x800 * (voice.adsr.sustain_level + 1);
+            volume = 0x800 * (voice.adsr.sustain_level + 1);
 
             shift = voice.adsr.sustain_shift - 11;
             voice.adsr_counter = 1 << std::max(0, shift); 
 
             if (voice.adsr.sustain_mode == AdsrMode::Exponential
                 && voice.adsr.sustain_direction == AdsrDirection::Increase
-                && voice.adsr_volume > 0x6000) {
+                && volume > 0x6000) {
                 voice.adsr_counter *= 4;
             }
         } else {
@@ -87,17 +301,17 @@ void Spu::AdsrStep(Voice& voice)
 
         if (voice.adsr.sustain_direction == AdsrDirection::Decrease
             && voice.adsr.sustain_mode == AdsrMode::Exponential) {
-            step = (step * voice.adsr_volume) >> 15;
+            step = (step * volume) >> 15;
         }
 
-        voice.adsr_volume = std::clamp(int32_t(voice.adsr_volume) + step, 0, INT16_MAX);
+        volume = std::clamp(int32_t(volume) + step, 0, INT16_MAX);
  
         shift = voice.adsr.sustain_shift - 11;
         voice.adsr_counter = 1 << std::max(0, shift); 
 
         if (voice.adsr.sustain_mode == AdsrMode::Exponential
             && voice.adsr.sustain_direction == AdsrDirection::Increase
-            && voice.adsr_volume > 0x6000) {
+            && volume > 0x6000) {
             voice.adsr_counter *= 4;
         } 
 
@@ -107,12 +321,12 @@ void Spu::AdsrStep(Voice& voice)
         step = -8 << step_shift;
 
         if (voice.adsr.release_mode == AdsrMode::Exponential) {
-            step = (step * voice.adsr_volume) >> 15;
+            step = (step * volume) >> 15;
         } 
 
-        voice.adsr_volume = std::clamp(int32_t(voice.adsr_volume) + step, 0, INT16_MAX);
+        volume = std::clamp(int32_t(volume) + step, 0, INT16_MAX);
 
-        if (voice.adsr_volume == 0) {
+        if (volume == 0) {
             voice.state = State::Off;
         } else {
             shift = voice.adsr.release_shift - 11;
@@ -126,32 +340,113 @@ void Spu::AdsrStep(Voice& voice)
    }
 }
 
-int16_t Spu::DecodeSample(Voice& voice, int16_t data)
+void Spu::DecodeBlock(Voice& voice)
 {
-    int32_t sample = SignExtend<4>(data);
-    int32_t prev = 0;
+    const size_t address = voice.current_address;
+    DecodedBlock& entry = m_decode_cache[(address / 8) % DecodeCacheSize];
 
-    prev += voice.prev_sample[0] * voice.filter1;
-    prev += voice.prev_sample[1] * voice.filter2;
+    /* an unfiltered block decodes the same whatever came before it */
+    const bool hit = entry.address == address
+        && (voice.header.filter == 0
+            || (entry.prev_sample[0] == voice.prev_sample[0]
+                && entry.prev_sample[1] == voice.prev_sample[1]));
 
-    sample = (sample << (12 - voice.header.range)) + prev / 64;
-    sample = std::clamp(sample, INT16_MIN, INT16_MAX);
+    if (!hit) {
+        entry.address = address;
+        entry.prev_sample[0] = voice.prev_sample[0];
+        entry.prev_sample[1] = voice.prev_sample[1];
 
-    voice.prev_sample[1] = voice.prev_sample[0];
-    voice.prev_sample[0] = sample;
+        int32_t prev0 = voice.prev_sample[0];
+        int32_t prev1 = voice.prev_sample[1];
 
-    return sample;
+        for (size_t i = 0; i < BlockSamples; ++i) {
+            const uint16_t data = m_sound_ram[(address + 1 + i / 4) & 0x3ffff];
+
+            int32_t sample = SignExtend<4>(data >> 4 * (i & 3));
+            sample = (sample << (12 - voice.header.range)) + (prev0 * voice.filter1 + prev1 * voice.filter2) / 64;
+            sample = std::clamp(sample, INT16_MIN, INT16_MAX);
+
+            entry.samples[i] = sample;
+
+            prev1 = prev0;
+            prev0 = sample;
+        }
+    }
+
+    /* the interpolator reaches back three samples into the previous block */
+    std::copy(voice.block.end() - 3, voice.block.end(), voice.block.begin());
+    std::copy(entry.samples.begin(), entry.samples.end(), voice.block.begin() + 3);
+
+    voice.prev_sample[0] = entry.samples[BlockSamples - 1];
+    voice.prev_sample[1] = entry.samples[BlockSamples - 2];
 }
 
-void Spu::Tick()
+void Spu::InvalidateDecodeCache(size_t address, size_t count)
 {
-    int16_t l = 0;
-    int16_t r = 0;
+    /* voices start on 8 byte boundaries, so a block may begin up to 7 halfwords earlier */
+    const size_t start = (address + SoundRamSize - 7) % SoundRamSize;
+    const size_t length = count + 7;
+
+    if (length >= 8 * DecodeCacheSize) {
+        for (DecodedBlock& entry : m_decode_cache) {
+            entry.address = NoBlock;
+        }
+
+        return;
+    }
+
+    for (size_t block = start / 8; block <= (start + length - 1) / 8; ++block) {
+        DecodedBlock& entry = m_decode_cache[block % DecodeCacheSize];
 
-    for (size_t i = 0; i < 24; ++i) {
+        if (entry.address != NoBlock && (entry.address - start) % SoundRamSize < length) {
+            entry.address = NoBlock;
+        }
+    }
+}
+
+void Spu::SoundRamWritten(size_t address, size_t count)
+{
+    InvalidateDecodeCache(address, count);
+
+    if (count >= SoundRamSize) {
+        m_sound_ram_dirty.MarkAll();
+        return;
+    }
+
+    const size_t first = std::min(count, SoundRamSize - address);
+
+    m_sound_ram_dirty.Mark(2 * address, 2 * first);
+    m_sound_ram_dirty.Mark(0, 2 * (count - first));
+}
+
+void Spu::StepNoise()
+{
+    m_noise_timer -= 4 + m_control.noise_step;
+
+    const int parity = ((m_noise_level >> 15) ^ (m_noise_level >> 12)
+                      ^ (m_noise_level >> 11) ^ (m_noise_level >> 10) ^ 1) & 1;
+
+    if (m_noise_timer < 0) {
+        m_noise_level = static_cast<int16_t>((m_noise_level << 1) | parity);
+
+        /* slow shifts can need two periods to climb back above zero */
+        m_noise_timer += 0x20000 >> m_control.noise_shift;
+
+        if (m_noise_timer < 0) {
+            m_noise_timer += 0x20000 >> m_control.noise_shift;
+        }
+    }
+}
+
+void Spu::RenderVoices(int16_t *dry, int16_t *effect)
+{
+    StepNoise();
+
+    for (size_t i = 0; i < VoiceCount; ++i) {
         Voice& voice = m_voices[i];
 
         if (voice.state == State::Off) {
+            m_lanes.sample[i] = 0;
             continue;
         }
 
@@ -173,15 +468,31 @@ void Spu::Tick()
             voice.filter1 = Filter1[voice.header.filter];
             voice.filter2 = Filter2[voice.header.filter];
 
+            DecodeBlock(voice);
+
             voice.header_processed = true;
-        } 
+        }
+
+        uint32_t step = voice.pitch;
 
-        uint16_t data = m_sound_ram[voice.current_address + 1 + voice.sample / 4];
-        int16_t sample = DecodeSample(voice, data >> 4 * (voice.sample & 3));
+        /* modulated by the previous voice's enveloped output, which has already run */
+        if (i > 0 && (m_pitch_mod_on.raw & (1 << i)) != 0) {
+            const int32_t factor = ((m_lanes.sample[i - 1] * m_lanes.envelope[i - 1]) >> 15) + 0x8000;
+            step = ((static_cast<int16_t>(step) * factor) >> 15) & 0xffff;
+        }
+
+        step = std::min(step, 0x4000u);
 
-        /* TODO: pitch modulation */
-        const uint16_t pitch = (voice.pitch > 0x4000) ? 0x4000 : voice.pitch;
-        voice.counter += pitch;
+        int16_t sample;
+
+        if ((m_noise_on.raw & (1 << i)) != 0) {
+            sample = m_noise_level;
+        } else {
+            const size_t position = (voice.counter >> 4) & 0xff;
+            sample = Interpolate(&voice.block[voice.sample], GaussianTaps[position].data());
+        }
+
+        voice.counter += step;
 
         voice.sample += voice.counter >> 12;
         voice.counter &= 0xfff;
@@ -198,25 +509,41 @@ void Spu::Tick()
 
                 if (!voice.header.loop) {
                     voice.state = State::Off;
-                    voice.adsr_volume = 0;
+                    m_lanes.envelope[i] = 0;
                 }
             }
 
             voice.header_processed = false;
         }
 
-        AdsrStep(voice);
-        sample = (sample * voice.adsr_volume) >> 15;
+        AdsrStep(i);
+        m_lanes.sample[i] = sample;
+    }
+
+    int32_t sums[4];
+    MixVoices(sums);
 
-        const int16_t samplel = (sample * voice.volume.l) >> 15;
-        const int16_t sampler = (sample * voice.volume.r) >> 15;
+    dry[0] = std::clamp(sums[0], INT16_MIN, INT16_MAX);
+    dry[1] = std::clamp(sums[1], INT16_MIN, INT16_MAX);
+    effect[0] = std::clamp(sums[2], INT16_MIN, INT16_MAX);
+    effect[1] = std::clamp(sums[3], INT16_MIN, INT16_MAX);
+}
 
-        l = std::clamp(int32_t(l) + samplel, INT16_MIN, INT16_MAX);
-        r = std::clamp(int32_t(r) + sampler, INT16_MIN, INT16_MAX);
-    }
+void Spu::OutputSample(const int16_t *dry, const int16_t *wet)
+{
+    int16_t l = (dry[0] * m_master_volume.l) >> 15;
+    int16_t r = (dry[1] * m_master_volume.r) >> 15;
 
-    l = (l * m_master_volume.l) >> 15;
-    r = (r * m_master_volume.r) >> 15;
+    l = std::clamp(int32_t(l) + ((wet[0] * m_effect_volume.l) >> 15), INT16_MIN, INT16_MAX);
+    r = std::clamp(int32_t(r) + ((wet[1] * m_effect_volume.r) >> 15), INT16_MIN, INT16_MAX);
+
+    /* the cd input drains at the output rate whether or not it is heard */
+    int16_t cd[2];
+
+    if (m_cd_fifo.Dequeue(cd, 2) == 2 && m_control.cd_enable) {
+        l = std::clamp(int32_t(l) + ((cd[0] * m_cd_volume.l) >> 15), INT16_MIN, INT16_MAX);
+        r = std::clamp(int32_t(r) + ((cd[1] * m_cd_volume.r) >> 15), INT16_MIN, INT16_MAX);
+    }
 
     m_sound_buffer[m_sound_buffer_index++] = l;
     m_sound_buffer[m_sound_buffer_index++] = r;
@@ -230,19 +557,317 @@ void Spu::Tick()
     }
 }
 
+#if defined(__SSE2__)
+
+/* (a * b) >> 15 of eight signed 16-bit lanes, widened to two vectors of 32 bits */
+static inline void MultiplyQ15(__m128i a, __m128i b, __m128i& lo, __m128i& hi)
+{
+    const __m128i low = _mm_mullo_epi16(a, b);
+    const __m128i high = _mm_mulhi_epi16(a, b);
+
+    lo = _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 15);
+    hi = _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 15);
+}
+
+static inline int32_t HorizontalSum(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(v);
+}
+
+#endif
+
+void Spu::MixVoices(int32_t *sums) const
+{
+#if defined(__SSE2__)
+    __m128i sum_l = _mm_setzero_si128();
+    __m128i sum_r = _mm_setzero_si128();
+    __m128i effect_l = _mm_setzero_si128();
+    __m128i effect_r = _mm_setzero_si128();
+
+    for (size_t i = 0; i < VoiceCount; i += 8) {
+        const __m128i sample = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_lanes.sample[i]));
+        const __m128i envelope = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_lanes.envelope[i]));
+        const __m128i volume_l = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_lanes.volume_l[i]));
+        const __m128i volume_r = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_lanes.volume_r[i]));
+        const __m128i effect = _mm_load_si128(reinterpret_cast<const __m128i *>(&m_lanes.effect[i]));
+
+        const __m128i effect_lo = _mm_unpacklo_epi16(effect, effect);
+        const __m128i effect_hi = _mm_unpackhi_epi16(effect, effect);
+
+        __m128i lo, hi;
+
+        MultiplyQ15(sample, envelope, lo, hi);
+        const __m128i enveloped = _mm_packs_epi32(lo, hi);
+
+        MultiplyQ15(enveloped, volume_l, lo, hi);
+        sum_l = _mm_add_epi32(sum_l, _mm_add_epi32(lo, hi));
+        effect_l = _mm_add_epi32(effect_l, _mm_add_epi32(_mm_and_si128(lo, effect_lo), _mm_and_si128(hi, effect_hi)));
+
+        MultiplyQ15(enveloped, volume_r, lo, hi);
+        sum_r = _mm_add_epi32(sum_r, _mm_add_epi32(lo, hi));
+        effect_r = _mm_add_epi32(effect_r, _mm_add_epi32(_mm_and_si128(lo, effect_lo), _mm_and_si128(hi, effect_hi)));
+    }
+
+    sums[0] = HorizontalSum(sum_l);
+    sums[1] = HorizontalSum(sum_r);
+    sums[2] = HorizontalSum(effect_l);
+    sums[3] = HorizontalSum(effect_r);
+#else
+    sums[0] = sums[1] = sums[2] = sums[3] = 0;
+
+    for (size_t i = 0; i < VoiceCount; ++i) {
+        const int32_t sample = (m_lanes.sample[i] * m_lanes.envelope[i]) >> 15;
+
+        const int32_t l = (sample * m_lanes.volume_l[i]) >> 15;
+        const int32_t r = (sample * m_lanes.volume_r[i]) >> 15;
+
+        sums[0] += l;
+        sums[1] += r;
+        sums[2] += l & m_lanes.effect[i];
+        sums[3] += r & m_lanes.effect[i];
+    }
+#endif
+}
+
+static inline int16_t Saturate(int32_t value)
+{
+    return std::clamp(value, INT16_MIN, INT16_MAX);
+}
+
+void Spu::UpdateReverbTables()
+{
+    const auto& reg = m_reverb_registers;
+
+    /* addresses are in units of 8 bytes, four halfwords */
+    const auto offset = [&reg](size_t index) { return 4 * static_cast<int32_t>(reg[index]); };
+
+    ReverbTables& t = m_reverb_tables;
+
+    t.reflect[0] = offset(ReverbLSame);
+    t.reflect[1] = offset(ReverbRSame);
+    t.reflect[2] = offset(ReverbLDiff);
+    t.reflect[3] = offset(ReverbRDiff);
+
+    /* each reflection feeds back the value one step behind where it writes */
+    for (size_t i = 0; i < 4; ++i) {
+        t.reflect_prev[i] = t.reflect[i] - 1;
+    }
+
+    /* different side reflections take the opposite channel's wall */
+    t.wall[0] = offset(ReverbDLSame);
+    t.wall[1] = offset(ReverbDRSame);
+    t.wall[2] = offset(ReverbDRDiff);
+    t.wall[3] = offset(ReverbDLDiff);
+
+    t.comb[0] = offset(ReverbLComb1);
+    t.comb[1] = offset(ReverbLComb2);
+    t.comb[2] = offset(ReverbLComb3);
+    t.comb[3] = offset(ReverbLComb4);
+    t.comb[4] = offset(ReverbRComb1);
+    t.comb[5] = offset(ReverbRComb2);
+    t.comb[6] = offset(ReverbRComb3);
+    t.comb[7] = offset(ReverbRComb4);
+
+    t.apf1[0] = offset(ReverbLApf1);
+    t.apf1[1] = offset(ReverbRApf1);
+    t.apf2[0] = offset(ReverbLApf2);
+    t.apf2[1] = offset(ReverbRApf2);
+
+    for (size_t i = 0; i < 2; ++i) {
+        t.apf1_delayed[i] = t.apf1[i] - offset(ReverbApfOffset1);
+        t.apf2_delayed[i] = t.apf2[i] - offset(ReverbApfOffset2);
+    }
+
+    t.iir = reg[ReverbIir];
+    t.wall_volume = reg[ReverbWall];
+    t.apf1_volume = reg[ReverbApf1];
+    t.apf2_volume = reg[ReverbApf2];
+    t.in_l = reg[ReverbInL];
+    t.in_r = reg[ReverbInR];
+
+    for (size_t i = 0; i < 4; ++i) {
+        t.comb_volume[i] = reg[ReverbComb1 + i];
+        t.comb_volume[4 + i] = reg[ReverbComb1 + i];
+    }
+}
+
+size_t Spu::ReverbAddress(int32_t offset) const
+{
+    /* the work area runs from the base to the end of sound ram and wraps */
+    const int64_t base = 4 * static_cast<int64_t>(m_effect_base);
+    const int64_t size = SoundRamSize - base;
+
+    int64_t relative = (static_cast<int64_t>(m_reverb_address) - base + offset) % size;
+
+    if (relative < 0) {
+        relative += size;
+    }
+
+    return base + relative;
+}
+
+int16_t Spu::ReverbRead(int32_t offset) const
+{
+    return m_sound_ram[ReverbAddress(offset)];
+}
+
+void Spu::ReverbWrite(int32_t offset, int16_t value)
+{
+    const size_t address = ReverbAddress(offset);
+
+    SoundRamWritten(address, 1);
+    m_sound_ram[address] = value;
+}
+
+void Spu::ReverbStep(const int16_t *input, int16_t *output)
+{
+    const ReverbTables& t = m_reverb_tables;
+
+    const int16_t in_l = (input[0] * t.in_l) >> 15;
+    const int16_t in_r = (input[1] * t.in_r) >> 15;
+
+    /* same side reflections, then different side, left before right */
+    alignas(16) int16_t in[8] = { in_l, in_r, in_l, in_r };
+    alignas(16) int16_t wall[8], prev[8], reflect[8];
+
+    for (size_t i = 0; i < 4; ++i) {
+        wall[i] = ReverbRead(t.wall[i]);
+        prev[i] = ReverbRead(t.reflect_prev[i]);
+    }
+
+    alignas(16) int16_t comb[8];
+
+    for (size_t i = 0; i < 8; ++i) {
+        comb[i] = ReverbRead(t.comb[i]);
+    }
+
+    int16_t echo[2];
+
+#if defined(__SSE2__)
+    const auto load = [](const int16_t *values) {
+        return _mm_load_si128(reinterpret_cast<const __m128i *>(values));
+    };
+
+    const auto multiply = [](__m128i a, __m128i b) {
+        __m128i lo, hi;
+        MultiplyQ15(a, b, lo, hi);
+        return _mm_packs_epi32(lo, hi);
+    };
+
+    const __m128i previous = load(prev);
+
+    __m128i x = _mm_adds_epi16(load(in), multiply(load(wall), _mm_set1_epi16(t.wall_volume)));
+    x = _mm_subs_epi16(x, previous);
+    x = _mm_adds_epi16(multiply(x, _mm_set1_epi16(t.iir)), previous);
+
+    _mm_store_si128(reinterpret_cast<__m128i *>(reflect), x);
+
+    /* four comb taps per channel in one multiply-add */
+    const __m128i pairs = _mm_madd_epi16(load(comb), load(t.comb_volume));
+    const __m128i sums = _mm_add_epi32(pairs, _mm_shuffle_epi32(pairs, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    echo[0] = Saturate(_mm_cvtsi128_si32(sums) >> 15);
+    echo[1] = Saturate(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)) >> 15);
+#else
+    for (size_t i = 0; i < 4; ++i) {
+        const int16_t x = Saturate(in[i] + ((wall[i] * t.wall_volume) >> 15) - prev[i]);
+        reflect[i] = Saturate(((x * t.iir) >> 15) + prev[i]);
+    }
+
+    for (size_t c = 0; c < 2; ++c) {
+        int32_t sum = 0;
+
+        for (size_t i = 0; i < 4; ++i) {
+            sum += comb[4 * c + i] * t.comb_volume[4 * c + i];
+        }
+
+        echo[c] = Saturate(sum >> 15);
+    }
+#endif
+
+    for (size_t i = 0; i < 4; ++i) {
+        ReverbWrite(t.reflect[i], reflect[i]);
+    }
+
+    /* the two all-pass stages, left and right side by side */
+    for (size_t c = 0; c < 2; ++c) {
+        const int16_t delayed1 = ReverbRead(t.apf1_delayed[c]);
+        const int16_t apf1 = Saturate(echo[c] - ((t.apf1_volume * delayed1) >> 15));
+
+        ReverbWrite(t.apf1[c], apf1);
+
+        const int16_t stage1 = Saturate(((apf1 * t.apf1_volume) >> 15) + delayed1);
+
+        const int16_t delayed2 = ReverbRead(t.apf2_delayed[c]);
+        const int16_t apf2 = Saturate(stage1 - ((t.apf2_volume * delayed2) >> 15));
+
+        ReverbWrite(t.apf2[c], apf2);
+
+        output[c] = Saturate(((apf2 * t.apf2_volume) >> 15) + delayed2);
+    }
+
+    m_reverb_address = ReverbAddress(1);
+}
+
+void Spu::ProcessReverb(size_t count)
+{
+    /*
+     * The unit runs at half rate: pairs of input frames are averaged
+     * into one step, and the outputs are interpolated back up, one
+     * frame behind.
+     */
+    for (size_t i = 0; i < count; ++i) {
+        const int16_t *input = &m_batch_effect[2 * i];
+        int16_t *wet = &m_batch_wet[2 * i];
+
+        if (!m_reverb_odd) {
+            m_reverb_input[0] = input[0];
+            m_reverb_input[1] = input[1];
+
+            wet[0] = m_reverb_output[0];
+            wet[1] = m_reverb_output[1];
+        } else {
+            const int16_t averaged[2] = {
+                static_cast<int16_t>((m_reverb_input[0] + input[0]) >> 1),
+                static_cast<int16_t>((m_reverb_input[1] + input[1]) >> 1)
+            };
+
+            int16_t output[2];
+            ReverbStep(averaged, output);
+
+            wet[0] = (m_reverb_output[0] + output[0]) >> 1;
+            wet[1] = (m_reverb_output[1] + output[1]) >> 1;
+
+            m_reverb_output[0] = output[0];
+            m_reverb_output[1] = output[1];
+        }
+
+        m_reverb_odd = !m_reverb_odd;
+    }
+}
+
 uint16_t Spu::Read(uint32_t addr)
 {
+    Sync();
+
     if (addr < 0x1f801d80) {
         const Voice& voice = m_voices[(addr - 0x1f801c00) >> 4];
 
         switch (addr & 0xf) {
         case 0x8: return voice.adsr.l;
         case 0xa: return voice.adsr.h;
-        case 0xc: return voice.adsr_volume;
+        case 0xc: return m_lanes.envelope[(addr - 0x1f801c00) >> 4];
         default: Error("read from unknown spu reg 0x{:08x}", addr);
         }
     }
 
+    if (addr >= 0x1f801dc0 && addr < 0x1f801e00) {
+        return m_reverb_registers[(addr - 0x1f801dc0) >> 1];
+    }
+
     switch (addr) {
     case 0x1f801d88: case 0x1f801d8a:
         spdlog::warn("read from write-only KON");
@@ -269,17 +894,21 @@ uint16_t Spu::Read(uint32_t addr)
 
 void Spu::Write(uint32_t addr, uint16_t data)
 {
+    /* writes, key on and key off included, land on the sample now due */
+    Sync();
+
     if (addr < 0x1f801d80) {
-        Voice& voice = m_voices[(addr - 0x1f801c00) >> 4];
+        const size_t index = (addr - 0x1f801c00) >> 4;
+        Voice& voice = m_voices[index];
 
         switch (addr & 0xf) {
-        case 0x0: voice.volume.l = data; break;
-        case 0x2: voice.volume.r = data; break;
+        case 0x0: m_lanes.volume_l[index] = data; break;
+        case 0x2: m_lanes.volume_r[index] = data; break;
         case 0x4: voice.pitch = data; break;
         case 0x6: voice.address = data; break;
         case 0x8: voice.adsr.l = data; break;
         case 0xa: voice.adsr.h = data; break;
-        case 0xc: voice.adsr_volume = data; break;
+        case 0xc: m_lanes.envelope[index] = data; break;
         case 0xe: voice.repeat_address = data; break;
         default: Error("write to unknown spu reg 0x{:08x}", addr);
         }
@@ -288,7 +917,8 @@ void Spu::Write(uint32_t addr, uint16_t data)
     }
 
     if (addr >= 0x1f801dc0 && addr < 0x1f801e00) {
-        spdlog::warn("write to spu effect reg 0x{:08x}", addr);
+        m_reverb_registers[(addr - 0x1f801dc0) >> 1] = data;
+        UpdateReverbTables();
         return;
     }
 
@@ -305,17 +935,28 @@ void Spu::Write(uint32_t addr, uint16_t data)
     case 0x1f801d92: m_pitch_mod_on.h = data; break;
     case 0x1f801d94: m_noise_on.l = data; break;
     case 0x1f801d96: m_noise_on.h = data; break;
-    case 0x1f801d98: m_effect_on.l = data; break;
-    case 0x1f801d9a: m_effect_on.h = data; break;
+    case 0x1f801d98:
+        m_effect_on.l = data;
+        UpdateEffectLanes();
+        break;
+    case 0x1f801d9a:
+        m_effect_on.h = data;
+        UpdateEffectLanes();
+        break;
     case 0x1f801d9c: case 0x1f801d9e:
         spdlog::warn("write to read-only ENDX");
         break;
-    case 0x1f801da2: m_effect_base = data; break;
+    case 0x1f801da2:
+        m_effect_base = data;
+        m_reverb_address = 4 * m_effect_base;
+        break;
     case 0x1f801da6:
         m_transfer_addr = data;
         m_transfer_current_addr = 4 * m_transfer_addr;
         break;
     case 0x1f801da8:
+        SoundRamWritten(m_transfer_current_addr, 1);
+
         m_sound_ram[m_transfer_current_addr++] = data;
         m_transfer_current_addr &= 0x3ffff;
         break;
@@ -339,6 +980,10 @@ void Spu::Write(uint32_t addr, uint16_t data)
 
 void Spu::WriteDma(uint32_t data)
 {
+    Sync();
+
+    SoundRamWritten(m_transfer_current_addr, 2);
+
     m_sound_ram[m_transfer_current_addr++] = data;
     m_transfer_current_addr &= 0x3ffff;
 
@@ -346,15 +991,50 @@ void Spu::WriteDma(uint32_t data)
     m_transfer_current_addr &= 0x3ffff;
 }
 
+void Spu::WriteDmaBlock(const uint32_t *data, size_t words)
+{
+    Sync();
+
+    const uint16_t *halves = reinterpret_cast<const uint16_t *>(data);
+    size_t count = 2 * words;
+
+    SoundRamWritten(m_transfer_current_addr, count);
+
+    while (count != 0) {
+        const size_t span = std::min(count, SoundRamSize - m_transfer_current_addr);
+
+        std::memcpy(&m_sound_ram[m_transfer_current_addr], halves, sizeof(uint16_t) * span);
+
+        m_transfer_current_addr = (m_transfer_current_addr + span) & 0x3ffff;
+        halves += span;
+        count -= span;
+    }
+}
+
+void Spu::UpdateEffectLanes()
+{
+    for (size_t i = 0; i < VoiceCount; ++i) {
+        m_lanes.effect[i] = (m_effect_on.raw & (1 << i)) ? -1 : 0;
+    }
+}
+
+void Spu::PushCdAudio(const int16_t *samples, size_t frames)
+{
+    /* a partial frame would swap the channels from then on */
+    const size_t count = std::min(2 * frames, m_cd_fifo.Availible() & ~size_t(1));
+
+    m_cd_fifo.Enqueue(samples, count);
+}
+
 void Spu::KeyOn(uint32_t value)
 {
-    for (size_t i = 0; i < 24; ++i) {
+    for (size_t i = 0; i < VoiceCount; ++i) {
         if ((value & (1 << i)) != 0) {
             m_voices[i].state = State::Attack;
 
             const int shift = m_voices[i].adsr.attack_shift - 11;
             m_voices[i].adsr_counter = 1 << std::max(0, shift);
-            m_voices[i].adsr_volume = 0;
+            m_lanes.envelope[i] = 0;
 
             m_voices[i].header_processed = false;
 
@@ -362,6 +1042,7 @@ void Spu::KeyOn(uint32_t value)
             m_voices[i].repeat_address = m_voices[i].address;
             m_voices[i].counter = m_voices[i].sample = 0;
             m_voices[i].prev_sample[0] = m_voices[i].prev_sample[1] = 0;
+            m_voices[i].block.fill(0);
 
             m_endx &= ~(1 << i);
         }
@@ -370,7 +1051,7 @@ void Spu::KeyOn(uint32_t value)
 
 void Spu::KeyOff(uint32_t value)
 {
-    for (size_t i = 0; i < 24; ++i) {
+    for (size_t i = 0; i < VoiceCount; ++i) {
         if ((value & (1 << i)) != 0) {
             m_voices[i].state = State::Release;
         }
@@ -7,17 +7,31 @@
 
 #include <common/bitfield.hpp>
 #include <common/cbuf.hpp>
+#include <common/dirty_pages.hpp>
+#include <common/serializer.hpp>
 
 namespace Core
 {
 
+class Emulator;
+
 class Spu {
 public:
-    Spu(bool enable_audio);
+    /* cpu cycles per 44.1 kHz output sample */
+    static constexpr int64_t SampleCycles = 768;
+
+    /* samples rendered per scheduler event when nothing forces a sync */
+    static constexpr size_t BatchSamples = 32;
+
+    Spu(Emulator *emulator, bool enable_audio);
 
     void Reset();
 
-    void Tick();
+    /* registers and voices; sound ram is left to the caller and must be in place before a load */
+    void DoState(Serializer& s);
+
+    /* renders every sample due up to the current time */
+    void Sync();
 
     inline Cbuf<int16_t, 8192> * SoundFifo()
     {
@@ -28,12 +42,40 @@ public:
     void Write(uint32_t addr, uint16_t data);
 
     void WriteDma(uint32_t data);
+    void WriteDmaBlock(const uint32_t *data, size_t words);
+
+    /* queues interleaved 44.1 kHz stereo frames from the cd controller */
+    void PushCdAudio(const int16_t *samples, size_t frames);
+
+    static constexpr size_t SoundRamSize = 512 * 512;
+
+    using SoundRamPages = DirtyPages<2 * SoundRamSize>;
+
+    inline uint16_t * SoundRam() { return m_sound_ram.data(); }
+    inline SoundRamPages& SoundRamDirty() { return m_sound_ram_dirty; }
 
 private:
+    void RenderBatch(size_t count);
+    void RenderVoices(int16_t *dry, int16_t *effect);
+    void OutputSample(const int16_t *dry, const int16_t *wet);
+
     void KeyOn(uint32_t value);
     void KeyOff(uint32_t value);
 
-    static constexpr size_t SoundRamSize = 512 * 512;
+    /* writes the dry left and right sums, then the sums of the voices sent to reverb */
+    void MixVoices(int32_t *sums) const;
+
+    void UpdateEffectLanes();
+
+    void UpdateReverbTables();
+    size_t ReverbAddress(int32_t offset) const;
+    int16_t ReverbRead(int32_t offset) const;
+    void ReverbWrite(int32_t offset, int16_t value);
+    void ReverbStep(const int16_t *input, int16_t *output);
+    void ProcessReverb(size_t count);
+
+    static constexpr size_t VoiceCount = 24;
+    static constexpr size_t BlockSamples = 28;
     static constexpr size_t SoundBufferSize = 256;
 
     static constexpr int Filter1[] = { 0, 60, 115, 98, 122 };
@@ -45,10 +87,6 @@ private:
     enum class AdsrDirection : bool { Increase, Decrease };
 
     struct Voice {
-        struct {
-            int16_t l, r;
-        } volume;
-
         uint16_t pitch;
         uint16_t address;
 
@@ -72,7 +110,6 @@ private:
         } adsr;
 
         size_t adsr_counter;
-        int16_t adsr_volume;
 
         uint16_t repeat_address;
 
@@ -95,11 +132,46 @@ private:
 
         int16_t prev_sample[2];
 
+        /* the block at current_address decoded in one go, after the last three samples of the one before */
+        std::array<int16_t, 3 + BlockSamples> block;
+
         State state;
-    } m_voices[24];
+    } m_voices[VoiceCount];
 
-    void AdsrStep(Voice& voice);
-    int16_t DecodeSample(Voice& voice, int16_t data);
+    /* the mixer's per-voice inputs, stored field by field to mix eight voices at a time */
+    struct {
+        alignas(16) std::array<int16_t, VoiceCount> sample;
+        alignas(16) std::array<int16_t, VoiceCount> envelope;
+        alignas(16) std::array<int16_t, VoiceCount> volume_l;
+        alignas(16) std::array<int16_t, VoiceCount> volume_r;
+        alignas(16) std::array<int16_t, VoiceCount> effect;
+    } m_lanes = {};
+
+    void AdsrStep(size_t index);
+    void StepNoise();
+
+    void DecodeBlock(Voice& voice);
+
+    /* address and count are in halfwords of sound ram */
+    void InvalidateDecodeCache(size_t address, size_t count);
+    void SoundRamWritten(size_t address, size_t count);
+
+    static constexpr size_t DecodeCacheSize = 4096;
+    static constexpr size_t NoBlock = SIZE_MAX;
+
+    /*
+     * Decoded blocks, direct mapped by address. Filtered blocks also
+     * depend on the history they were decoded with, so that is kept to
+     * check against; looped instruments settle into the same history
+     * each time round and hit.
+     */
+    struct DecodedBlock {
+        size_t address = NoBlock;
+        int16_t prev_sample[2];
+        std::array<int16_t, BlockSamples> samples;
+    };
+
+    std::array<DecodedBlock, DecodeCacheSize> m_decode_cache;
 
     union {
         uint32_t raw;
@@ -131,6 +203,8 @@ private:
         BitField<uint16_t, TransferMode, 4, 2> transfer_mode;
         BitField<uint16_t, bool, 6, 1> interrupt_enable;
         BitField<uint16_t, bool, 7, 1> effect_enable;
+        BitField<uint16_t, uint16_t, 8, 2> noise_step;
+        BitField<uint16_t, uint16_t, 10, 4> noise_shift;
         BitField<uint16_t, bool, 14, 1> master_mute;
         BitField<uint16_t, bool, 15, 1> master_enable;
     } m_control;
@@ -150,15 +224,62 @@ private:
         BitField<uint16_t, bool, 10, 1> dma_busy;
     } m_status;
 
-    uint16_t m_effect_base;
+    uint16_t m_effect_base = 0;
+
+    enum ReverbRegister : size_t {
+        ReverbApfOffset1, ReverbApfOffset2, ReverbIir,
+        ReverbComb1, ReverbComb2, ReverbComb3, ReverbComb4,
+        ReverbWall, ReverbApf1, ReverbApf2,
+        ReverbLSame, ReverbRSame, ReverbLComb1, ReverbRComb1, ReverbLComb2, ReverbRComb2,
+        ReverbDLSame, ReverbDRSame, ReverbLDiff, ReverbRDiff,
+        ReverbLComb3, ReverbRComb3, ReverbLComb4, ReverbRComb4,
+        ReverbDLDiff, ReverbDRDiff, ReverbLApf1, ReverbRApf1, ReverbLApf2, ReverbRApf2,
+        ReverbInL, ReverbInR,
+        ReverbRegisterCount
+    };
+
+    std::array<uint16_t, ReverbRegisterCount> m_reverb_registers = {};
+
+    /* the registers turned into halfword offsets from the current address, rebuilt on write */
+    struct ReverbTables {
+        /* left same, right same, left different, right different */
+        int32_t reflect[4], reflect_prev[4], wall[4];
+
+        /* left combs then right combs */
+        int32_t comb[8];
+        alignas(16) int16_t comb_volume[8];
+
+        int32_t apf1[2], apf1_delayed[2];
+        int32_t apf2[2], apf2_delayed[2];
+
+        int16_t iir, wall_volume, apf1_volume, apf2_volume;
+        int16_t in_l, in_r;
+    } m_reverb_tables = {};
+
+    size_t m_reverb_address;
+    bool m_reverb_odd;
+    int16_t m_reverb_input[2], m_reverb_output[2];
+
+    std::array<int16_t, 2 * BatchSamples> m_batch_dry, m_batch_effect, m_batch_wet;
+
+    int32_t m_noise_timer;
+    int16_t m_noise_level;
 
     std::array<uint16_t, SoundRamSize> m_sound_ram;
+    SoundRamPages m_sound_ram_dirty;
 
     size_t m_sound_buffer_index = 0;
     std::array<int16_t, SoundBufferSize> m_sound_buffer;
 
+    /* output is only rendered up to here, and caught up before it is observed */
+    int64_t m_sync_time = 0;
+
     bool m_enable_audio;
     Cbuf<int16_t, 8192> m_sound_fifo;
+
+    Cbuf<int16_t, 32768> m_cd_fifo;
+
+    Emulator *m_emulator;
 };
 
 }
@@ -6,126 +6,173 @@
 
 #include "emulator.hpp"
 #include "error.hpp"
+#include "gpu.hpp"
 #include "intc.hpp"
+#include "scheduler.hpp"
 #include "timer.hpp"
 
 namespace Core
 {
 
+static constexpr Scheduler::Event::Type TimerEvent[] = {
+    Scheduler::Event::Type::Timer0,
+    Scheduler::Event::Type::Timer1,
+    Scheduler::Event::Type::Timer2
+};
+
+static constexpr Interrupt TimerInterrupt[] = {
+    Interrupt::Timer0,
+    Interrupt::Timer1,
+    Interrupt::Timer2
+};
+
 template <std::size_t Index>
 void Timer<Index>::Reset()
 {
-    m_counter = m_prescaler = m_mode.raw = m_target = 0;
+    m_counter = m_mode.raw = m_target = 0;
     m_mode.nirq = true;
+
+    m_sync_time = m_emulator->m_scheduler->CurrentTime();
+    m_sync_phase = 0;
+    m_pending_target = false;
+
+    if (m_emulator->m_scheduler->EventActive(TimerEvent[Index])) {
+        m_emulator->m_scheduler->RemoveEvent(TimerEvent[Index]);
+    }
 }
 
-template <>
-void Timer<1>::Tick()
+template <std::size_t Index>
+void Timer<Index>::DoState(Serializer& s)
 {
-    if (m_mode.source == 1 || m_mode.source == 3) {
-        if ((++m_prescaler % 2100) != 0) {
-            return;
+    s.Do(m_mode);
+    s.Do(m_counter);
+    s.Do(m_target);
+    s.Do(m_sync_time);
+    s.Do(m_sync_phase);
+    s.Do(m_pending_target);
+
+    m_emulator->m_scheduler->DoEvent(s, TimerEvent[Index], [=]() { FireInterrupt(); });
+}
+
+template <std::size_t Index>
+s64 Timer<Index>::Period() const
+{
+    switch (Index) {
+    case 0:
+        if (m_mode.source & 0x1) {
+            return VideoSubcycles * m_emulator->m_gpu->DotClockDivider();
         }
+
+        return Subcycles;
+    case 1: return Subcycles * ((m_mode.source & 0x1) ? HblankCycles : 1);
+    case 2: return Subcycles * ((m_mode.source & 0x2) ? 8 : 1);
+    default: Error("invalid timer({})", Index);
     }
+}
 
-    m_counter += 1;
+template <std::size_t Index>
+void Timer<Index>::Sync()
+{
+    const s64 period = Period();
+    const s64 elapsed = Subcycles * (m_emulator->m_scheduler->CurrentTime() - m_sync_time) - m_sync_phase;
 
-    if (m_mode.target_irq_enable && m_counter == m_target) {
-        m_mode.target = true;
+    s64 ticks = elapsed / period;
 
-        if (m_mode.toggle) {
-            m_mode.nirq = !m_mode.nirq;
-
-            if (!m_mode.nirq) {
-                m_emulator->m_intc->AssertInterrupt(Interrupt::Timer1);
-            }
-        } else {
-            m_mode.nirq = false;
-            m_emulator->m_intc->AssertInterrupt(Interrupt::Timer1);
-        }
+    /* whatever is left of a tick carries over as the phase */
+    const s64 consumed = m_sync_phase + ticks * period;
 
-        if (m_mode.target_reset) {
-            m_counter = 0;
-        }
-    } else if (m_mode.overflow_irq_enable && m_counter == 0) {
-        m_mode.overflow = true;
+    m_sync_time += consumed / Subcycles;
+    m_sync_phase = consumed % Subcycles;
 
-        if (m_mode.toggle) {
-            m_mode.nirq = !m_mode.nirq;
-
-            if (!m_mode.nirq) {
-                m_mode.nirq = false;
-                m_emulator->m_intc->AssertInterrupt(Interrupt::Timer1);
-            }
-        } else {
-            m_emulator->m_intc->AssertInterrupt(Interrupt::Timer1);
+    /* a counter written above the target runs on to the wrap first */
+    const u32 wrap = (m_mode.target_reset && m_target != 0) ? m_target : 0x10000;
+
+    if (m_counter >= wrap) {
+        const s64 overflow = 0x10000 - m_counter;
+
+        if (ticks < overflow) {
+            m_counter += ticks;
+            return;
         }
+
+        ticks -= overflow;
+        m_counter = 0;
     }
+
+    m_counter = (m_counter + ticks) % wrap;
 }
 
 template <std::size_t Index>
-void Timer<Index>::Tick()
+void Timer<Index>::ScheduleInterrupt()
 {
-    Interrupt i;
+    Scheduler *scheduler = m_emulator->m_scheduler.get();
 
-    switch (Index) {
-    case 0:
-        i = Interrupt::Timer0;
-        break;
-    case 1:
-        i = Interrupt::Timer1;
-        break;
-    case 2:
-        i = Interrupt::Timer2;
-        break;
-    default: Error("invalid timer({})", Index);
+    if (scheduler->EventActive(TimerEvent[Index])) {
+        scheduler->RemoveEvent(TimerEvent[Index]);
     }
 
-    if ((++m_prescaler % 8) != 0) {
+    const bool resets = m_mode.target_reset && m_target != 0 && m_counter < m_target;
+
+    s64 ticks = INT64_MAX;
+
+    if (m_mode.target_irq_enable) {
+        const u32 distance = (m_target - m_counter) & 0xffff;
+        ticks = (distance == 0) ? 0x10000 : distance;
+        m_pending_target = true;
+    }
+
+    if (m_mode.overflow_irq_enable && !resets && (0x10000 - m_counter) < ticks) {
+        ticks = 0x10000 - m_counter;
+        m_pending_target = false;
+    }
+
+    if (ticks == INT64_MAX) {
         return;
     }
 
-    /* TODO: source */
-    m_counter += 1;
+    const s64 elapsed = Subcycles * (scheduler->CurrentTime() - m_sync_time) - m_sync_phase;
+    const s64 remaining = ticks * Period() - elapsed;
 
-    if (m_mode.target_irq_enable && m_counter == m_target) {
-        m_mode.target = true;
+    scheduler->AddEvent(
+        TimerEvent[Index],
+        Scheduler::Event::Mode::Once,
+        (remaining + Subcycles - 1) / Subcycles,
+        [=]() { FireInterrupt(); }
+    );
+}
 
-        if (m_mode.toggle) {
-            m_mode.nirq = !m_mode.nirq;
-
-            if (!m_mode.nirq) {
-                m_emulator->m_intc->AssertInterrupt(i);
-            }
-        } else {
-            m_mode.nirq = false;
-            m_emulator->m_intc->AssertInterrupt(i);
-        }
+template <std::size_t Index>
+void Timer<Index>::FireInterrupt()
+{
+    Sync();
 
-        if (m_mode.target_reset) {
-            m_counter = 0;
-        }
-    } else if (m_mode.overflow_irq_enable && m_counter == 0) {
+    if (m_pending_target) {
+        m_mode.target = true;
+    } else {
         m_mode.overflow = true;
+    }
 
-        if (m_mode.toggle) {
-            m_mode.nirq = !m_mode.nirq;
-
-            if (!m_mode.nirq) {
-                m_mode.nirq = false;
-                m_emulator->m_intc->AssertInterrupt(i);
-            }
-        } else {
-            m_emulator->m_intc->AssertInterrupt(i);
+    if (m_mode.toggle) {
+        m_mode.nirq = !m_mode.nirq;
+
+        if (!m_mode.nirq) {
+            m_emulator->m_intc->AssertInterrupt(TimerInterrupt[Index]);
         }
+    } else {
+        m_mode.nirq = false;
+        m_emulator->m_intc->AssertInterrupt(TimerInterrupt[Index]);
     }
+
+    ScheduleInterrupt();
 }
 
 template <std::size_t Index>
 u16 Timer<Index>::Read(u32 addr)
 {
     switch (addr & 0xf) {
-    case 0x0: return m_counter;
+    case 0x0:
+        Sync();
+        return m_counter;
     case 0x4: return m_mode.raw;
     case 0x8: return m_target;
     default: Error("read from unknown timer reg 0x{:08x}", addr);
@@ -135,6 +182,8 @@ u16 Timer<Index>::Read(u32 addr)
 template <std::size_t Index>
 void Timer<Index>::Write(u32 addr, u16 data)
 {
+    Sync();
+
     switch (addr & 0xf) {
     case 0x0:
         m_counter = data;
@@ -152,13 +201,16 @@ void Timer<Index>::Write(u32 addr, u16 data)
         }
 
         m_counter = 0;
-        m_prescaler = 0;
+        m_sync_time = m_emulator->m_scheduler->CurrentTime();
+        m_sync_phase = 0;
         break;
     case 0x8:
         m_target = data;
         break;
     default: Error("write to unknown timer reg 0x{:08x}", addr);
     }
+
+    ScheduleInterrupt();
 }
 
 template class Timer<0>;
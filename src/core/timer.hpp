@@ -3,6 +3,7 @@
 #include <cstddef>
 
 #include <common/bitfield.hpp>
+#include <common/serializer.hpp>
 #include <common/types.hpp>
 
 namespace Core
@@ -16,13 +17,27 @@ public:
     Timer(Emulator *emulator) : m_emulator(emulator) { Reset(); }
 
     void Reset();
-
-    void Tick();
+    void DoState(Serializer& s);
 
     u16 Read(u32 addr);
     void Write(u32 addr, u16 data);
 
+    /* a clock source changing rate is bracketed by these, syncing at the old rate */
+    void Sync();
+    void ScheduleInterrupt();
+
 private:
+    /* time is kept in elevenths of a cpu cycle, in which a video clock cycle is exactly 7 */
+    static constexpr s64 Subcycles = 11;
+    static constexpr s64 VideoSubcycles = 7;
+
+    static constexpr s64 HblankCycles = 2100;
+
+    /* in subcycles */
+    s64 Period() const;
+
+    void FireInterrupt();
+
     union {
         u16 raw;
 
@@ -39,7 +54,11 @@ private:
         BitField<u16, bool, 12, 1> overflow; //
     } m_mode;
 
-    u16 m_counter, m_prescaler, m_target;
+    u16 m_counter, m_target;
+
+    /* the counter is only brought up to date when it is observed, m_sync_phase subcycles past m_sync_time */
+    s64 m_sync_time, m_sync_phase;
+    bool m_pending_target;
 
     Emulator *m_emulator;
 };
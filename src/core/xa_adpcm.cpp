@@ -0,0 +1,259 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "error.hpp"
+#include "xa_adpcm.hpp"
+
+namespace Core
+{
+
+/*
+ * Windowed sinc low-pass at 90% of the input nyquist, split into one
+ * set of taps per phase. Each phase is normalised to unity gain so that
+ * silence and DC come out unchanged whatever the phase.
+ */
+static std::array<std::array<int16_t, 16>, 7> MakeResampleTable()
+{
+    constexpr size_t Phases = 7;
+    constexpr size_t Taps = 16;
+    constexpr size_t Length = Phases * Taps;
+
+    constexpr double Pi = 3.14159265358979323846;
+    constexpr double Cutoff = 0.9 * 0.5 / Phases;
+
+    double prototype[Length];
+
+    for (size_t i = 0; i < Length; ++i) {
+        const double x = i - (Length - 1) / 2.0;
+        const double sinc = (x == 0.0) ? 1.0 : std::sin(2.0 * Pi * Cutoff * x) / (2.0 * Pi * Cutoff * x);
+        const double window = 0.42 - 0.5 * std::cos(2.0 * Pi * i / (Length - 1))
+                                   + 0.08 * std::cos(4.0 * Pi * i / (Length - 1));
+
+        prototype[i] = sinc * window;
+    }
+
+    std::array<std::array<int16_t, Taps>, Phases> table;
+
+    for (size_t phase = 0; phase < Phases; ++phase) {
+        double sum = 0.0;
+
+        for (size_t k = 0; k < Taps; ++k) {
+            sum += prototype[phase + Phases * k];
+        }
+
+        /* taps run from the oldest input sample to the newest */
+        for (size_t k = 0; k < Taps; ++k) {
+            const double tap = prototype[phase + Phases * k] / sum;
+            table[phase][Taps - 1 - k] = static_cast<int16_t>(std::lround(tap * 32767.0));
+        }
+    }
+
+    return table;
+}
+
+static const std::array<std::array<int16_t, 16>, 7> ResampleTable = MakeResampleTable();
+
+void XaAdpcm::Reset()
+{
+    for (Channel& channel : m_channels) {
+        channel.prev_sample[0] = channel.prev_sample[1] = 0;
+        channel.count = 0;
+        channel.samples.fill(0);
+    }
+
+    m_position = 0;
+}
+
+void XaAdpcm::DoState(Serializer& s)
+{
+    for (Channel& channel : m_channels) {
+        s.Do(channel.prev_sample);
+        s.Do(channel.count);
+
+        if (channel.count > MaxSamples) {
+            Error("xa sample count out of range {}", channel.count);
+        }
+
+        /* only the history and the samples of the last sector mean anything */
+        s.DoBytes(channel.samples.data(), sizeof(int16_t) * (Taps - 1 + channel.count));
+    }
+
+    s.Do(m_position);
+}
+
+size_t XaAdpcm::DecodeSector(const uint8_t *sector, int16_t *output)
+{
+    const uint8_t coding = sector[19];
+
+    const bool stereo = (coding & 0x3) == 1;
+    const bool half_rate = ((coding >> 2) & 0x3) == 1;
+    const bool wide = ((coding >> 4) & 0x3) == 1;
+
+    const size_t units = wide ? 4 : 8;
+
+    m_channels[0].count = m_channels[1].count = 0;
+
+    for (size_t i = 0; i < GroupCount; ++i) {
+        const uint8_t *group = &sector[24 + GroupSize * i];
+
+        /* stereo sectors alternate left and right units */
+        for (size_t unit = 0; unit < units; ++unit) {
+            DecodeUnit(group, unit, wide, m_channels[stereo ? (unit & 1) : 0]);
+        }
+    }
+
+    const size_t step = half_rate ? 3 : 6;
+    size_t position = m_position;
+
+    const size_t frames = Resample(m_channels[0], position, step, output);
+
+    if (stereo) {
+        size_t right = m_position;
+        Resample(m_channels[1], right, step, output + 1);
+    } else {
+        for (size_t i = 0; i < frames; ++i) {
+            output[2 * i + 1] = output[2 * i];
+        }
+    }
+
+    m_position = position;
+
+    return frames;
+}
+
+/*
+ * With the sample moved to the top of the word, shifting it back down by
+ * 16 + range leaves it at 12 - range bits up for 4-bit units and 8 - range
+ * for 8-bit ones. Ranges past 12 are reserved and behave like 9.
+ */
+static constexpr int ExpandShift(int range)
+{
+    return 16 + ((range > 12) ? 9 : range);
+}
+
+static constexpr int32_t ExpandSample(uint32_t word, int left, int bits, int range)
+{
+    return static_cast<int32_t>((word << left) & (~0u << (32 - bits))) >> ExpandShift(range);
+}
+
+/* unit 0 sits in the low bits of each word */
+static_assert(ExpandSample(0x1, 28, 4, 0) == 4096);
+static_assert(ExpandSample(0x1, 28, 4, 12) == 1);
+static_assert(ExpandSample(0xf, 28, 4, 12) == -1);
+static_assert(ExpandSample(0x8, 28, 4, 0) == -32768);
+static_assert(ExpandSample(0x7, 28, 4, 13) == 7 << 3);
+static_assert(ExpandSample(0x01, 24, 8, 0) == 256);
+static_assert(ExpandSample(0x01, 24, 8, 8) == 1);
+static_assert(ExpandSample(0xff, 24, 8, 8) == -1);
+static_assert(ExpandSample(0x7f, 24, 8, 0) == 127 << 8);
+
+void XaAdpcm::DecodeUnit(const uint8_t *group, size_t unit, bool wide, Channel& channel)
+{
+    const uint8_t header = group[4 + unit];
+
+    const int range = header & 0xf;
+    const int filter = (header >> 4) & 0x3;
+
+    /* every 32-bit word of the group holds one sample of each unit */
+    const int bits = wide ? 8 : 4;
+    const int left = 32 - bits - bits * static_cast<int>(unit);
+
+    int32_t expanded[UnitSamples];
+
+#if defined(__SSE2__)
+    const __m128i left_count = _mm_cvtsi32_si128(left);
+    const __m128i right_count = _mm_cvtsi32_si128(ExpandShift(range));
+    const __m128i top = _mm_set1_epi32(~0u << (32 - bits));
+
+    static_assert(UnitSamples % 4 == 0);
+
+    for (size_t i = 0; i < UnitSamples; i += 4) {
+        __m128i words = _mm_loadu_si128(reinterpret_cast<const __m128i *>(&group[16 + 4 * i]));
+
+        words = _mm_and_si128(_mm_sll_epi32(words, left_count), top);
+        words = _mm_sra_epi32(words, right_count);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(&expanded[i]), words);
+    }
+#else
+    for (size_t i = 0; i < UnitSamples; ++i) {
+        uint32_t word;
+        std::memcpy(&word, &group[16 + 4 * i], sizeof(word));
+
+        expanded[i] = ExpandSample(word, left, bits, range);
+    }
+#endif
+
+    int16_t *samples = &channel.samples[Taps - 1 + channel.count];
+
+    int32_t prev0 = channel.prev_sample[0];
+    int32_t prev1 = channel.prev_sample[1];
+
+    for (size_t i = 0; i < UnitSamples; ++i) {
+        int32_t sample = expanded[i] + ((prev0 * Filter1[filter] + prev1 * Filter2[filter] + 32) >> 6);
+        sample = std::clamp(sample, INT16_MIN, INT16_MAX);
+
+        samples[i] = sample;
+
+        prev1 = prev0;
+        prev0 = sample;
+    }
+
+    channel.prev_sample[0] = prev0;
+    channel.prev_sample[1] = prev1;
+
+    channel.count += UnitSamples;
+}
+
+static inline int32_t DotProduct(const int16_t *samples, const int16_t *taps)
+{
+#if defined(__SSE2__)
+    const __m128i lo = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(samples)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(taps)));
+    const __m128i hi = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(samples + 8)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(taps + 8)));
+
+    __m128i sum = _mm_add_epi32(lo, hi);
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+
+    return _mm_cvtsi128_si32(sum);
+#else
+    int32_t sum = 0;
+
+    for (size_t i = 0; i < 16; ++i) {
+        sum += samples[i] * taps[i];
+    }
+
+    return sum;
+#endif
+}
+
+size_t XaAdpcm::Resample(Channel& channel, size_t& position, size_t step, int16_t *output)
+{
+    size_t frames = 0;
+
+    /* the newest sample under each output is samples[Taps - 1 + position / Phases] */
+    for (; position / Phases < channel.count; position += step) {
+        const int16_t *samples = &channel.samples[position / Phases];
+        const int32_t sum = DotProduct(samples, ResampleTable[position % Phases].data());
+
+        output[2 * frames++] = std::clamp(sum >> 15, INT16_MIN, INT16_MAX);
+    }
+
+    position -= Phases * channel.count;
+
+    std::memmove(channel.samples.data(), &channel.samples[channel.count], sizeof(int16_t) * (Taps - 1));
+
+    return frames;
+}
+
+}
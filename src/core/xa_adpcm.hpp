@@ -0,0 +1,60 @@
+#ifndef CORE_XA_ADPCM_HPP
+#define CORE_XA_ADPCM_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <common/serializer.hpp>
+
+namespace Core
+{
+
+/*
+ * Decodes the sound groups of realtime XA audio sectors and resamples
+ * them from 37.8 or 18.9 kHz to the 44.1 kHz the SPU mixes at.
+ */
+class XaAdpcm {
+public:
+    /* a mono 18.9 kHz sector holds the most samples, each stretched by 7/3 */
+    static constexpr size_t MaxFrames = 18 * 8 * 28 * 7 / 3 + 1;
+
+    XaAdpcm() { Reset(); }
+
+    void Reset();
+    void DoState(Serializer& s);
+
+    /* writes interleaved stereo frames to output, returns how many */
+    size_t DecodeSector(const uint8_t *sector, int16_t *output);
+
+private:
+    static constexpr size_t GroupCount = 18;
+    static constexpr size_t GroupSize = 128;
+    static constexpr size_t UnitSamples = 28;
+    static constexpr size_t MaxSamples = GroupCount * 8 * UnitSamples;
+
+    /* 44.1 kHz is 7/6 of 37.8 kHz, positions are counted in sevenths */
+    static constexpr size_t Phases = 7;
+    static constexpr size_t Taps = 16;
+
+    static constexpr int32_t Filter1[] = { 0, 60, 115, 98 };
+    static constexpr int32_t Filter2[] = { 0, 0, -52, -55 };
+
+    struct Channel {
+        int32_t prev_sample[2];
+
+        /* the last Taps - 1 samples of the previous sector lead the new ones */
+        size_t count;
+        std::array<int16_t, Taps - 1 + MaxSamples> samples;
+    };
+
+    void DecodeUnit(const uint8_t *group, size_t unit, bool wide, Channel& channel);
+    size_t Resample(Channel& channel, size_t& position, size_t step, int16_t *output);
+
+    Channel m_channels[2];
+    size_t m_position;
+};
+
+}
+
+#endif /* CORE_XA_ADPCM_HPP */
@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <common/types.hpp>
+
+#include <core/disc/bin.hpp>
+#include <core/disc/compressed_bin.hpp>
+#include <core/disc/cue.hpp>
+
+#include <fmt/core.h>
+
+#include <spdlog/spdlog.h>
+
+#include <zlib.h>
+
+using CompressedBin = Core::CompressedBin;
+
+static constexpr u32 HunkSectors = 8;
+static_assert(HunkSectors <= CompressedBin::MaxHunkSectors, "hunks too large to load");
+static constexpr std::size_t PreGapSectors = 150;
+
+static std::unique_ptr<Core::Disc> OpenDisc(const std::filesystem::path& path)
+{
+    if (path.extension() == ".bin") {
+        return std::make_unique<Core::Bin>(path);
+    } else if (path.extension() == ".cue") {
+        return std::make_unique<Core::Cue>(path);
+    }
+
+    throw std::runtime_error(fmt::format("unsupported disc format {}", path.extension().string()));
+}
+
+static void Pack(Core::Disc& disc, std::ofstream& output)
+{
+    CompressedBin::Header header = {};
+
+    std::memcpy(header.magic, CompressedBin::Magic, sizeof(header.magic));
+    header.version = CompressedBin::Version;
+    header.hunk_sectors = HunkSectors;
+    header.sectors = disc.SectorCount();
+    header.hunks = (header.sectors + HunkSectors - 1) / HunkSectors;
+
+    std::vector<CompressedBin::HunkEntry> hunks(header.hunks);
+
+    /* the index is rewritten once every hunk has an offset */
+    output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    output.write(reinterpret_cast<const char *>(hunks.data()), hunks.size() * sizeof(hunks[0]));
+
+    std::vector<u8> raw(HunkSectors * CompressedBin::SectorSize);
+    std::vector<u8> packed(compressBound(raw.size()));
+
+    u64 offset = sizeof(header) + hunks.size() * sizeof(hunks[0]);
+    u64 stored = 0;
+
+    for (u32 i = 0; i < header.hunks; ++i) {
+        const u32 first = i * HunkSectors;
+        const u32 count = std::min(HunkSectors, header.sectors - first);
+        const std::size_t length = count * CompressedBin::SectorSize;
+
+        for (u32 j = 0; j < count; ++j) {
+            disc.Read(&raw[j * CompressedBin::SectorSize], PreGapSectors + first + j);
+        }
+
+        uLongf size = packed.size();
+
+        if (compress2(packed.data(), &size, raw.data(), length, Z_BEST_COMPRESSION) != Z_OK) {
+            throw std::runtime_error(fmt::format("unable to compress hunk {}", i));
+        }
+
+        CompressedBin::HunkEntry& entry = hunks[i];
+
+        entry.offset = offset;
+
+        /* keep incompressible hunks as they are */
+        if (size < length) {
+            entry.size = size;
+            entry.codec = CompressedBin::Codec::Zlib;
+            output.write(reinterpret_cast<const char *>(packed.data()), size);
+        } else {
+            entry.size = length;
+            entry.codec = CompressedBin::Codec::Stored;
+            output.write(reinterpret_cast<const char *>(raw.data()), length);
+            stored++;
+        }
+
+        offset += entry.size;
+    }
+
+    output.seekp(sizeof(header));
+    output.write(reinterpret_cast<const char *>(hunks.data()), hunks.size() * sizeof(hunks[0]));
+
+    if (!output) {
+        throw std::runtime_error("unable to write output");
+    }
+
+    fmt::print("{} sectors in {} hunks ({} stored), {} -> {} bytes\n",
+               header.sectors, header.hunks, stored,
+               u64(header.sectors) * CompressedBin::SectorSize, offset);
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_pattern("[%T:%e] [%^%l%$] %v");
+    spdlog::set_level(spdlog::level::warn);
+
+    if (argc < 3) {
+        fmt::print(stderr, "usage: {} <disc.bin|disc.cue> <output.cbin>\n", argv[0]);
+        return 1;
+    }
+
+    std::ofstream output(argv[2], std::ios::binary);
+
+    if (!output.is_open()) {
+        spdlog::error("unable to open {}", argv[2]);
+        return 1;
+    }
+
+    try {
+        const std::unique_ptr<Core::Disc> disc = OpenDisc(argv[1]);
+
+        Pack(*disc, output);
+        return 0;
+    } catch (const std::exception& e) {
+        spdlog::error("pack failed: {}", e.what());
+        return 1;
+    }
+}
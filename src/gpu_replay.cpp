@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <common/serializer.hpp>
+#include <common/types.hpp>
+
+#include <core/gpu.hpp>
+#include <core/gpu_recorder.hpp>
+
+#include <fmt/core.h>
+
+#include <spdlog/spdlog.h>
+
+using Record = Core::GpuRecorder::Record;
+
+class CaptureReader {
+public:
+    CaptureReader(std::vector<u8> data) : m_data(std::move(data)) {}
+
+    inline bool Done() const { return m_offset >= m_data.size(); }
+
+    template <typename T>
+    T Read()
+    {
+        T value;
+        ReadInto(&value, sizeof(value));
+        return value;
+    }
+
+    /* Returns a pointer to size bytes of the capture and skips past them */
+    const u8 * Consume(std::size_t size)
+    {
+        if (m_offset + size > m_data.size()) {
+            throw std::runtime_error("truncated capture");
+        }
+
+        const u8 *data = &m_data[m_offset];
+        m_offset += size;
+        return data;
+    }
+
+private:
+    inline void ReadInto(void *dst, std::size_t size)
+    {
+        std::memcpy(dst, Consume(size), size);
+    }
+
+    std::vector<u8> m_data;
+    std::size_t m_offset = 0;
+};
+
+struct FrameResult {
+    double microseconds;
+    Core::Gpu::Statistics stats;
+};
+
+static void ReportFrame(std::size_t index, const FrameResult& frame)
+{
+    fmt::print("frame {:5}: {:9.3f} ms, {:6} polygons, {:6} rectangles, "
+               "{:4} fills, {:4} copies, {:4} transfers\n",
+               index, frame.microseconds / 1000.0,
+               frame.stats.polygons, frame.stats.rectangles,
+               frame.stats.fills, frame.stats.copies, frame.stats.transfers);
+}
+
+static int Replay(CaptureReader& capture, bool quiet)
+{
+    char magic[sizeof(Core::GpuRecorder::Magic)];
+    std::memcpy(magic, capture.Consume(sizeof(magic)), sizeof(magic));
+
+    if (std::memcmp(magic, Core::GpuRecorder::Magic, sizeof(magic)) != 0) {
+        spdlog::error("not a gpu capture");
+        return 1;
+    }
+
+    const u32 version = capture.Read<u32>();
+
+    if (version != Core::GpuRecorder::Version) {
+        spdlog::error("unsupported capture version {}", version);
+        return 1;
+    }
+
+    auto gpu = std::make_unique<Core::Gpu>();
+    std::vector<u32> scratch;
+    std::vector<FrameResult> frames;
+
+    using Clock = std::chrono::steady_clock;
+    Clock::duration elapsed = Clock::duration::zero();
+
+    while (!capture.Done()) {
+        const Record record = capture.Read<Record>();
+        const auto start = Clock::now();
+
+        switch (record) {
+        case Record::Gp0:
+            gpu->Gp0(capture.Read<u32>());
+            break;
+        case Record::Gp1:
+            gpu->Gp1(capture.Read<u32>());
+            break;
+        case Record::Dma: {
+            const u32 count = capture.Read<u32>();
+            const u8 *data = capture.Consume(sizeof(u32) * count);
+
+            scratch.resize(count);
+            std::memcpy(scratch.data(), data, sizeof(u32) * count);
+            gpu->Gp0Block(scratch.data(), count);
+            break;
+        }
+        case Record::Read: {
+            const u32 count = capture.Read<u32>();
+
+            scratch.resize(count);
+            gpu->GpuReadBlock(scratch.data(), count);
+            break;
+        }
+        case Record::Vblank: {
+            gpu->Vblank();
+
+            elapsed += Clock::now() - start;
+
+            FrameResult frame;
+            frame.microseconds = std::chrono::duration<double, std::micro>(elapsed).count();
+            frame.stats = gpu->Stats();
+            frames.push_back(frame);
+
+            if (!quiet) {
+                ReportFrame(frames.size() - 1, frame);
+            }
+
+            gpu->ResetStats();
+            elapsed = Clock::duration::zero();
+            continue;
+        }
+        case Record::Vram:
+            std::memcpy(gpu->Vram(), capture.Consume(2 * 1024 * 512), 2 * 1024 * 512);
+            continue;
+        case Record::State: {
+            const u32 size = capture.Read<u32>();
+
+            Serializer s(capture.Consume(size), size);
+            gpu->DoState(s);
+            continue;
+        }
+        default:
+            spdlog::error("unknown record type {}", static_cast<int>(record));
+            return 1;
+        }
+
+        elapsed += Clock::now() - start;
+    }
+
+    if (frames.empty()) {
+        spdlog::warn("capture contains no complete frames");
+        return 0;
+    }
+
+    double total = 0.0;
+    double worst = 0.0;
+
+    for (const FrameResult& frame : frames) {
+        total += frame.microseconds;
+        worst = std::max(worst, frame.microseconds);
+    }
+
+    fmt::print("{} frames, mean {:.3f} ms, worst {:.3f} ms, total {:.3f} ms\n",
+               frames.size(), total / frames.size() / 1000.0,
+               worst / 1000.0, total / 1000.0);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_pattern("[%T:%e] [%^%l%$] %v");
+    spdlog::set_level(spdlog::level::warn);
+
+    if (argc < 2) {
+        fmt::print(stderr, "usage: {} <capture> [--quiet]\n", argv[0]);
+        return 1;
+    }
+
+    const bool quiet = argc > 2 && std::strcmp(argv[2], "--quiet") == 0;
+
+    std::ifstream file(argv[1], std::ios::binary);
+
+    if (!file.is_open()) {
+        spdlog::error("unable to open {}", argv[1]);
+        return 1;
+    }
+
+    std::vector<u8> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+
+    CaptureReader capture(std::move(data));
+
+    try {
+        return Replay(capture, quiet);
+    } catch (const std::exception& e) {
+        spdlog::error("replay failed: {}", e.what());
+        return 1;
+    }
+}
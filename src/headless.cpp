@@ -0,0 +1,519 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <common/types.hpp>
+
+#include <core/emulator.hpp>
+#include <core/frame.hpp>
+#include <core/save_state.hpp>
+#include <core/spu.hpp>
+
+#include <fmt/core.h>
+
+#include <spdlog/spdlog.h>
+
+struct Options {
+    std::filesystem::path bios;
+    std::filesystem::path disc;
+    std::filesystem::path exe;
+
+    std::size_t frames = 3600;
+    std::size_t exe_frame = 180;
+
+    std::filesystem::path hashes;
+    std::filesystem::path png;
+    std::size_t png_interval = 60;
+    std::filesystem::path wav;
+
+    Core::DiscAccess disc_access = Core::DiscAccess::ReadAhead;
+
+    std::filesystem::path load_state;
+    std::filesystem::path save_state;
+    std::size_t snapshots = 0;
+
+    std::size_t sessions = 1;
+    std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+    std::string log_level = "warn";
+};
+
+static void PrintUsage(const char *name)
+{
+    fmt::print(stderr,
+               "usage: {} --bios <file> [--disc <file>] [--exe <file>] [options]\n"
+               "  --frames <n>        frames to run (default 3600)\n"
+               "  --exe-frame <n>     frame at which the exe replaces the running bios (default 180)\n"
+               "  --hashes <file>     write a hash of every displayed frame\n"
+               "  --png <dir>         write displayed frames as png\n"
+               "  --png-interval <n>  frames between png dumps (default 60)\n"
+               "  --wav <file>        write the audio output\n"
+               "  --disc-access <how> read_ahead or mapped (default read_ahead)\n"
+               "  --load-state <file> start from a saved state instead of power on\n"
+               "  --save-state <file> save the state reached after the last frame\n"
+               "  --snapshots <n>     capture a rewind snapshot every frame, keeping n, and time it\n"
+               "  --sessions <n>      independent emulators to run (default 1)\n"
+               "  --threads <n>       threads to spread sessions over (default one per core)\n"
+               "  --log-level <level> spdlog level (default warn)\n",
+               name);
+}
+
+static std::optional<Options> ParseArgs(int argc, char **argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+
+        if (i + 1 >= argc) {
+            spdlog::error("{} needs a value", arg);
+            return std::nullopt;
+        }
+
+        const char *value = argv[++i];
+
+        try {
+            if (arg == "--bios") {
+                options.bios = value;
+            } else if (arg == "--disc") {
+                options.disc = value;
+            } else if (arg == "--exe") {
+                options.exe = value;
+            } else if (arg == "--frames") {
+                options.frames = std::stoul(value);
+            } else if (arg == "--exe-frame") {
+                options.exe_frame = std::stoul(value);
+            } else if (arg == "--hashes") {
+                options.hashes = value;
+            } else if (arg == "--png") {
+                options.png = value;
+            } else if (arg == "--png-interval") {
+                options.png_interval = std::max<std::size_t>(std::stoul(value), 1);
+            } else if (arg == "--wav") {
+                options.wav = value;
+            } else if (arg == "--disc-access") {
+                const std::string access = value;
+
+                if (access == "mapped") {
+                    options.disc_access = Core::DiscAccess::Mapped;
+                } else if (access == "read_ahead") {
+                    options.disc_access = Core::DiscAccess::ReadAhead;
+                } else {
+                    throw std::invalid_argument(value);
+                }
+            } else if (arg == "--load-state") {
+                options.load_state = value;
+            } else if (arg == "--save-state") {
+                options.save_state = value;
+            } else if (arg == "--snapshots") {
+                options.snapshots = std::stoul(value);
+            } else if (arg == "--sessions") {
+                options.sessions = std::max<std::size_t>(std::stoul(value), 1);
+            } else if (arg == "--threads") {
+                options.threads = std::max<std::size_t>(std::stoul(value), 1);
+            } else if (arg == "--log-level") {
+                options.log_level = value;
+            } else {
+                spdlog::error("unknown option {}", arg);
+                return std::nullopt;
+            }
+        } catch (const std::exception&) {
+            spdlog::error("bad value {} for {}", value, arg);
+            return std::nullopt;
+        }
+    }
+
+    if (options.bios.empty()) {
+        spdlog::error("no bios given");
+        return std::nullopt;
+    }
+
+    return options;
+}
+
+/* FNV-1a over the dimensions and visible pixels */
+static u64 HashFrame(const Core::Frame& frame)
+{
+    u64 hash = 0xcbf29ce484222325;
+
+    const auto mix = [&hash](const void *data, std::size_t size) {
+        const u8 *bytes = static_cast<const u8 *>(data);
+
+        for (std::size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3;
+        }
+    };
+
+    const u32 dimensions[2] = { static_cast<u32>(frame.width), static_cast<u32>(frame.height) };
+
+    mix(dimensions, sizeof(dimensions));
+    mix(frame.pixels.data(), sizeof(u32) * frame.width * frame.height);
+
+    return hash;
+}
+
+static const std::array<u32, 256> CrcTable = []() {
+    std::array<u32, 256> table;
+
+    for (u32 i = 0; i < 256; ++i) {
+        u32 crc = i;
+
+        for (std::size_t bit = 0; bit < 8; ++bit) {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+        }
+
+        table[i] = crc;
+    }
+
+    return table;
+}();
+
+static u32 Crc32(u32 crc, const u8 *data, std::size_t size)
+{
+    crc = ~crc;
+
+    for (std::size_t i = 0; i < size; ++i) {
+        crc = CrcTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+static void PutBigEndian(std::vector<u8>& out, u32 value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<u8>(value >> shift));
+    }
+}
+
+static void WriteChunk(std::ofstream& file, const char *type, const std::vector<u8>& data)
+{
+    std::vector<u8> chunk;
+
+    PutBigEndian(chunk, static_cast<u32>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    PutBigEndian(chunk, Crc32(0, &chunk[4], chunk.size() - 4));
+
+    file.write(reinterpret_cast<const char *>(chunk.data()), chunk.size());
+}
+
+/* an RGB png using stored deflate blocks, which needs no compression library */
+static void WritePng(const std::filesystem::path& path, const Core::Frame& frame)
+{
+    std::ofstream file(path, std::ios::binary);
+
+    if (!file.is_open()) {
+        spdlog::error("unable to open {}", path.string());
+        return;
+    }
+
+    static const u8 Signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    file.write(reinterpret_cast<const char *>(Signature), sizeof(Signature));
+
+    std::vector<u8> header;
+    PutBigEndian(header, static_cast<u32>(frame.width));
+    PutBigEndian(header, static_cast<u32>(frame.height));
+    header.insert(header.end(), { 8, 2, 0, 0, 0 });
+
+    WriteChunk(file, "IHDR", header);
+
+    /* each row starts with filter type zero, and the pixels are RGBA in memory */
+    std::vector<u8> raw;
+    raw.reserve((3 * frame.width + 1) * frame.height);
+
+    for (std::size_t y = 0; y < frame.height; ++y) {
+        raw.push_back(0);
+
+        for (std::size_t x = 0; x < frame.width; ++x) {
+            const u32 pixel = frame.pixels[y * frame.width + x];
+
+            raw.push_back(pixel & 0xff);
+            raw.push_back((pixel >> 8) & 0xff);
+            raw.push_back((pixel >> 16) & 0xff);
+        }
+    }
+
+    std::vector<u8> data = { 0x78, 0x01 };
+    u32 a = 1, b = 0;
+
+    std::size_t offset = 0;
+
+    do {
+        const std::size_t length = std::min<std::size_t>(raw.size() - offset, 0xffff);
+        const bool last = offset + length == raw.size();
+
+        data.push_back(last ? 1 : 0);
+        data.push_back(length & 0xff);
+        data.push_back(length >> 8);
+        data.push_back(~length & 0xff);
+        data.push_back((~length >> 8) & 0xff);
+        data.insert(data.end(), raw.begin() + offset, raw.begin() + offset + length);
+
+        offset += length;
+    } while (offset < raw.size());
+
+    for (const u8 byte : raw) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    PutBigEndian(data, (b << 16) | a);
+
+    WriteChunk(file, "IDAT", data);
+    WriteChunk(file, "IEND", {});
+}
+
+/* 16-bit stereo pcm, with the sizes filled in as the file is closed */
+class WavWriter {
+public:
+    WavWriter(const std::filesystem::path& path) : m_file(path, std::ios::binary)
+    {
+        if (!m_file.is_open()) {
+            throw std::runtime_error("unable to open " + path.string());
+        }
+
+        WriteHeader();
+    }
+
+    ~WavWriter()
+    {
+        m_file.seekp(0);
+        WriteHeader();
+    }
+
+    void Write(const s16 *samples, std::size_t count)
+    {
+        m_file.write(reinterpret_cast<const char *>(samples), sizeof(s16) * count);
+        m_bytes += static_cast<u32>(sizeof(s16) * count);
+    }
+
+private:
+    void WriteHeader()
+    {
+        struct {
+            char riff[4] = { 'R', 'I', 'F', 'F' };
+            u32 riff_size;
+            char wave[4] = { 'W', 'A', 'V', 'E' };
+            char fmt[4] = { 'f', 'm', 't', ' ' };
+            u32 fmt_size = 16;
+            u16 format = 1;
+            u16 channels = 2;
+            u32 rate = 44100;
+            u32 byte_rate = 44100 * 4;
+            u16 align = 4;
+            u16 bits = 16;
+            char data[4] = { 'd', 'a', 't', 'a' };
+            u32 data_size;
+        } header;
+
+        static_assert(sizeof(header) == 44, "wav header must be packed");
+
+        header.riff_size = 36 + m_bytes;
+        header.data_size = m_bytes;
+
+        m_file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    }
+
+    std::ofstream m_file;
+    u32 m_bytes = 0;
+};
+
+/* one full copy of memory per second of history, the rest are deltas */
+static constexpr std::size_t SnapshotKeyframeInterval = 60;
+
+/* with several sessions each writes its own files, suffixed with its index */
+static std::filesystem::path SessionPath(const std::filesystem::path& path, std::size_t session,
+                                         std::size_t sessions)
+{
+    if (path.empty() || sessions == 1) {
+        return path;
+    }
+
+    std::filesystem::path result = path;
+    result.replace_filename(fmt::format("{}.{}{}", path.stem().string(), session, path.extension().string()));
+    return result;
+}
+
+static void RunSession(const Options& options, std::size_t session)
+{
+    const std::filesystem::path hashes_path = SessionPath(options.hashes, session, options.sessions);
+    const std::filesystem::path png_path = SessionPath(options.png, session, options.sessions);
+    const std::filesystem::path wav_path = SessionPath(options.wav, session, options.sessions);
+    const std::filesystem::path state_path = SessionPath(options.save_state, session, options.sessions);
+
+    const bool audio = !wav_path.empty();
+
+    auto e = std::make_unique<Core::Emulator>(options.bios, options.disc, audio, options.disc_access);
+
+    if (!options.load_state.empty()) {
+        Core::SaveStates::Load(e.get(), options.load_state);
+    }
+
+    std::unique_ptr<Core::SaveStates> snapshots;
+
+    if (options.snapshots != 0) {
+        snapshots = std::make_unique<Core::SaveStates>(e.get(), options.snapshots, SnapshotKeyframeInterval);
+    }
+
+    std::ofstream hashes;
+
+    if (!hashes_path.empty()) {
+        hashes.open(hashes_path);
+
+        if (!hashes.is_open()) {
+            throw std::runtime_error("unable to open " + hashes_path.string());
+        }
+    }
+
+    if (!png_path.empty()) {
+        std::filesystem::create_directories(png_path);
+    }
+
+    std::unique_ptr<WavWriter> wav;
+
+    if (audio) {
+        wav = std::make_unique<WavWriter>(wav_path);
+    }
+
+    using Clock = std::chrono::steady_clock;
+
+    Clock::duration emulated = Clock::duration::zero();
+    Clock::duration captured = Clock::duration::zero();
+    Clock::duration slowest = Clock::duration::zero();
+    const auto start = Clock::now();
+
+    std::array<s16, 4096> samples;
+
+    for (std::size_t frame = 0; frame < options.frames; ++frame) {
+        if (!options.exe.empty() && frame == options.exe_frame) {
+            e->LoadExe(options.exe);
+        }
+
+        const auto before = Clock::now();
+        e->RunFrame();
+        emulated += Clock::now() - before;
+
+        if (snapshots) {
+            const auto capture = Clock::now();
+            snapshots->Capture();
+
+            const Clock::duration elapsed = Clock::now() - capture;
+            captured += elapsed;
+            slowest = std::max(slowest, elapsed);
+        }
+
+        if (wav) {
+            std::size_t count;
+
+            while ((count = e->m_spu->SoundFifo()->Dequeue(samples.data(), samples.size())) != 0) {
+                wav->Write(samples.data(), count);
+            }
+        }
+
+        if (!e->m_swapchain.Acquire()) {
+            continue;
+        }
+
+        const Core::Frame& image = e->m_swapchain.ConsumerBuffer();
+
+        if (hashes.is_open()) {
+            hashes << fmt::format("{:6} {}x{} {:016x}\n", frame, image.width, image.height, HashFrame(image));
+        }
+
+        if (!png_path.empty() && frame % options.png_interval == 0 && image.width != 0) {
+            WritePng(png_path / fmt::format("frame_{:06}.png", frame), image);
+        }
+    }
+
+    const double total = std::chrono::duration<double>(Clock::now() - start).count();
+    const double running = std::chrono::duration<double>(emulated).count();
+
+    fmt::print("session {}: {} frames in {:.3f} s: {:.2f} fps, {:.2f} fps emulating alone\n",
+               session, options.frames, total, options.frames / total, options.frames / running);
+
+    if (snapshots && options.frames != 0) {
+        const double mean = std::chrono::duration<double, std::micro>(captured).count() / options.frames;
+        const double worst = std::chrono::duration<double, std::micro>(slowest).count();
+
+        fmt::print("session {}: snapshots took {:.1f} us on average, {:.1f} us at worst\n", session, mean, worst);
+    }
+
+    if (!state_path.empty()) {
+        Core::SaveStates::Save(e.get(), state_path);
+    }
+}
+
+/* sessions are handed out to a fixed pool of threads, each running one to completion at a time */
+static int Run(const Options& options)
+{
+    const std::size_t threads = std::min(options.threads, options.sessions);
+
+    std::atomic<std::size_t> next = 0;
+    std::atomic<std::size_t> failed = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+
+    const auto worker = [&]() {
+        for (std::size_t session; (session = next++) < options.sessions; ) {
+            try {
+                RunSession(options, session);
+            } catch (const std::exception& e) {
+                spdlog::error("session {} failed: {}", session, e.what());
+                ++failed;
+            }
+        }
+    };
+
+    std::vector<std::thread> pool;
+
+    for (std::size_t i = 1; i < threads; ++i) {
+        pool.emplace_back(worker);
+    }
+
+    worker();
+
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+
+    if (options.sessions > 1) {
+        const double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const std::size_t frames = (options.sessions - failed) * options.frames;
+
+        fmt::print("{} sessions on {} threads: {} frames in {:.3f} s, {:.2f} fps combined\n",
+                   options.sessions, threads, frames, total, frames / total);
+    }
+
+    return failed == 0 ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    spdlog::set_pattern("[%T:%e] [%^%l%$] %v");
+    spdlog::set_level(spdlog::level::warn);
+
+    const std::optional<Options> options = ParseArgs(argc, argv);
+
+    if (!options) {
+        PrintUsage(argv[0]);
+        return 1;
+    }
+
+    spdlog::set_level(spdlog::level::from_str(options->log_level));
+
+    return Run(*options);
+}
@@ -4,16 +4,18 @@
 #include <cmath>
 #include <cstddef>
 #include <cstdint>
-#include <cstring>
 #include <fstream>
 #include <map>
 #include <memory>
+#include <string>
 #include <thread>
 
 #include <common/cbuf.hpp>
+#include <common/resampler.hpp>
 #include <common/types.hpp>
 
 #include <core/emulator.hpp>
+#include <core/frame.hpp>
 #include <core/spu.hpp>
 #include <core/joypad/joypad.hpp>
 
@@ -38,27 +40,22 @@ static const std::map<std::size_t, Core::Key> KeyMap = {
     {9, Core::Key::Start}
 };
 
+using AudioFifo = Cbuf<s16, 8192>;
+
+/* frames queued ahead of the device, and frames rendered per video frame */
+static constexpr std::size_t AudioLatencyFrames = 1024;
+static constexpr std::size_t AudioFrameFrames = 44100 / 60;
+
 static SDL_AudioDeviceID audio_device;
-static Cbuf<s16, 8192> *audio_fifo;
+static AudioFifo *audio_fifo;
 
 static std::atomic<bool> running;
 
 void AudioCallback(void *userdata, u8 *stream, int length)
 {
-    (void)userdata;
-
-    s16 *buffer = reinterpret_cast<s16 *>(stream);
+    auto *resampler = static_cast<Resampler<AudioFifo> *>(userdata);
 
-    length /= 2;
-    length = std::min(static_cast<int>(audio_fifo->Size()), length);
-
-    const std::size_t read = audio_fifo->Dequeue(buffer, length);
-
-    if (read == 0) {
-        std::memset(stream, 0, length);
-    } else if (static_cast<int>(read) < length) {
-        std::memset(&buffer[read], buffer[read - 1], length - read);
-    }
+    resampler->Resample(reinterpret_cast<s16 *>(stream), length / (2 * sizeof(s16)));
 }
 
 void RunCoreThread(std::shared_ptr<Core::Emulator> e)
@@ -71,6 +68,15 @@ void RunCoreThread(std::shared_ptr<Core::Emulator> e)
     auto last = std::chrono::high_resolution_clock::now();
 
     while (running) {
+        /*
+         * With audio on the device sets the pace: hold off while more
+         * than the target latency is queued, counting half of the frame
+         * about to be rendered.
+         */
+        while (running && audio_fifo->Size() / 2 + AudioFrameFrames / 2 > AudioLatencyFrames) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
         e->RunFrame();
 
         auto current = std::chrono::high_resolution_clock::now();
@@ -151,9 +157,25 @@ int main(int argc, char **argv)
         }
     }
 
-    auto e = std::make_shared<Core::Emulator>(bios, disc, enable_audio);
+    Core::DiscAccess disc_access = Core::DiscAccess::ReadAhead;
+
+    if (config.contains("disc_access")) {
+        const auto access = config["disc_access"];
+
+        if (access == "mapped") {
+            disc_access = Core::DiscAccess::Mapped;
+        } else if (access != "read_ahead") {
+            spdlog::warn("unknown disc access option \"{}\"", access);
+        }
+    }
+
+    auto e = std::make_shared<Core::Emulator>(bios, disc, enable_audio, disc_access);
     e->Reset();
 
+    if (config.contains("gpu_capture")) {
+        e->StartGpuCapture(config["gpu_capture"].get<std::string>());
+    }
+
     audio_fifo = e->m_spu->SoundFifo();
 
     if (SDL_Init(SDL_INIT_JOYSTICK | SDL_INIT_AUDIO | SDL_INIT_VIDEO) < 0) {
@@ -174,8 +196,8 @@ int main(int argc, char **argv)
         "btpsx",
          SDL_WINDOWPOS_UNDEFINED,
          SDL_WINDOWPOS_UNDEFINED,
-         1024,
-         512,
+         640,
+         480,
          SDL_WINDOW_SHOWN
     );
 
@@ -198,10 +220,10 @@ int main(int argc, char **argv)
 
     SDL_Texture *texture = SDL_CreateTexture(
         renderer,
-        SDL_PIXELFORMAT_ABGR1555,
+        SDL_PIXELFORMAT_ABGR8888,
         SDL_TEXTUREACCESS_STREAMING,
-        1024,
-        512
+        Core::Frame::MaxWidth,
+        Core::Frame::MaxHeight
     );
 
     if (texture == nullptr) {
@@ -211,6 +233,8 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    Resampler<AudioFifo> resampler(*audio_fifo, AudioLatencyFrames);
+
     if (enable_audio) {
         SDL_AudioSpec want, have;
         SDL_zero(want);
@@ -218,8 +242,9 @@ int main(int argc, char **argv)
         want.freq = 44100;
         want.format = AUDIO_S16SYS;
         want.channels = 2;
-        want.samples = 2048;
+        want.samples = 512;
         want.callback = AudioCallback;
+        want.userdata = &resampler;
 
         audio_device = SDL_OpenAudioDevice(nullptr, 0, &want, &have, 0);
 
@@ -238,6 +263,7 @@ int main(int argc, char **argv)
     std::thread core_thread(RunCoreThread, e);
 
     SDL_Event event;
+    SDL_Rect display = { 0, 0, 0, 0 };
 
     while (running) { 
         if (SDL_PollEvent(&event)) {
@@ -301,25 +327,23 @@ int main(int argc, char **argv)
             }
         }
 
-        void *pixels;
-        int pitch;
+        if (e->m_swapchain.Acquire()) {
+            const Core::Frame& frame = e->m_swapchain.ConsumerBuffer();
 
-        SDL_LockTexture(texture, nullptr, &pixels, &pitch);
+            display.w = static_cast<int>(frame.width);
+            display.h = static_cast<int>(frame.height);
 
-        e->m_swapchain.WithConsumer([=](u8 *buffer) {
-            u8 *p = reinterpret_cast<u8 *>(pixels);
+            /* the frame is uploaded straight from the swapchain buffer */
+            SDL_UpdateTexture(texture, &display, frame.pixels.data(),
+                              static_cast<int>(sizeof(u32) * frame.width));
+        }
 
-            for (std::size_t y = 0; y < 512; ++y) {
-                std::memcpy(p, buffer, 2 * 1024);
-                buffer += 2 * 1024;
-                p += pitch;
-            }
-        });
+        SDL_RenderClear(renderer);
 
-        SDL_UnlockTexture(texture);
+        if (display.w > 0 && display.h > 0) {
+            SDL_RenderCopy(renderer, texture, &display, nullptr);
+        }
 
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, nullptr, nullptr);
         SDL_RenderPresent(renderer);
     }
 